@@ -0,0 +1,175 @@
+#ifndef PHEAP_DE_H
+#define PHEAP_DE_H
+
+/*	This file contains an implementation of a double-ended pairing heap.
+
+	Elements are kept in two PHEAP_V2.h heaps in total correspondence: every
+	element of the min heap is paired (ph_twin) with a not smaller element of the
+	max heap, an odd element waits in a single slot buffer. Each element lives in
+	exactly one heap, so no node is duplicated.
+
+	available operations:
+	pde_push, pde_push_bounded, pde_min, pde_max, pde_pop_min, pde_pop_max,
+	pde_merge_heaps, pde_destroy_heap
+
+	ph_min needs a comparator ordering the elements ascending and ph_max
+	a comparator ordering them descending, e.g.
+
+		PDE_HEAP heap = { .ph_min.ph_cmp = asc, .ph_max.ph_cmp = desc };
+
+	Some definitions can be overridden, define PARAM_DEFINED to indicate a modification	*/
+
+/*	Intrusive PH_NODE structure, a user defined node must provide the ph_twin field	*/
+#ifndef PH_NODE_DEFINED
+typedef struct ph_node {
+	struct ph_node *ph_list, *ph_child, *ph_parent, *ph_twin;
+} PH_NODE;
+#define PH_NODE_DEFINED
+#endif
+
+#include "PHEAP_V2.h"
+
+/*	Double-ended heap structure, ph_capacity is used only by pde_push_bounded	*/
+#ifndef PDE_HEAP_DEFINED
+typedef struct pde_heap {
+	PH_HEAP ph_min, ph_max;
+	PH_NODE *ph_buffer;
+	size_t ph_size, ph_capacity;
+} PDE_HEAP;
+#define PDE_HEAP_DEFINED
+#endif
+
+/*	Pairs node with the buffered element or stores it in the buffer	*/
+PH_INTERNAL_EXPORT void
+__pde_insert(PDE_HEAP *heap, PH_NODE *node) {
+
+	PH_NODE *buffer = heap->ph_buffer;
+	if(! buffer) {
+		heap->ph_buffer = node;
+		return;
+	}
+	heap->ph_buffer = NULL;
+	if(PH_ISGREATER(&heap->ph_min, buffer, node)) {
+		PH_NODE *tmp = buffer;
+		buffer = node;
+		node = tmp;
+	}
+	node->ph_twin = buffer;
+	buffer->ph_twin = node;
+	ph_push_raw(&heap->ph_min, node);
+	ph_push_raw(&heap->ph_max, buffer);
+}
+
+/*	Push implementation, initializes all link fields of the node	*/
+PH_EXPORT void
+pde_push(PDE_HEAP *heap, PH_NODE *node) {
+
+	++heap->ph_size;
+	__pde_insert(heap, node);
+}
+
+/*	Returns the smallest element without removing it	*/
+PH_EXPORT PH_NODE *
+pde_min(PDE_HEAP *heap) {
+
+	PH_NODE *root = heap->ph_min.ph_root, *buffer = heap->ph_buffer;
+	return buffer && (! root || ! PH_ISGREATER(&heap->ph_min, root, buffer))
+		? buffer
+		: root;
+}
+
+/*	Returns the largest element without removing it	*/
+PH_EXPORT PH_NODE *
+pde_max(PDE_HEAP *heap) {
+
+	PH_NODE *root = heap->ph_max.ph_root, *buffer = heap->ph_buffer;
+	return buffer && (! root || ! PH_ISGREATER(&heap->ph_max, root, buffer))
+		? buffer
+		: root;
+}
+
+/*	Detaches the top element of one side, its twin is removed from
+	the opposite side and inserted again	*/
+PH_INTERNAL_EXPORT PH_NODE *
+__pde_pop(PDE_HEAP *heap, PH_HEAP *side, PH_HEAP *other) {
+
+	PH_NODE *root = side->ph_root, *buffer = heap->ph_buffer;
+	if(buffer && (! root || ! PH_ISGREATER(side, root, buffer))) {
+		heap->ph_buffer = NULL;
+		--heap->ph_size;
+		return buffer;
+	}
+	if(! root) return NULL;
+
+	ph_pop(side);
+	PH_NODE *twin = root->ph_twin;
+	ph_remove_at(other, twin);
+	__pde_insert(heap, twin);
+	--heap->ph_size;
+	return root;
+}
+
+/*	Removes and returns the smallest element, NULL if the heap is empty	*/
+PH_EXPORT PH_NODE *
+pde_pop_min(PDE_HEAP *heap) {
+
+	return __pde_pop(heap, &heap->ph_min, &heap->ph_max);
+}
+
+/*	Removes and returns the largest element, NULL if the heap is empty	*/
+PH_EXPORT PH_NODE *
+pde_pop_max(PDE_HEAP *heap) {
+
+	return __pde_pop(heap, &heap->ph_max, &heap->ph_min);
+}
+
+/*	Push for a heap limited to ph_capacity elements. On overflow the largest
+	element is evicted and returned, it can be the pushed node itself.
+	No memory is allocated, the caller owns the returned node	*/
+PH_EXPORT PH_NODE *
+pde_push_bounded(PDE_HEAP *heap, PH_NODE *node) {
+
+	if(heap->ph_size < heap->ph_capacity) {
+		pde_push(heap, node);
+		return NULL;
+	}
+	PH_NODE *max = pde_max(heap);
+	if(! max || ! PH_ISGREATER(&heap->ph_max, max, node))
+		return node;
+
+	max = pde_pop_max(heap);
+	pde_push(heap, node);
+	return max;
+}
+
+/*	Merges two heaps, result is stored in dst heap structure.
+	The function uses comparators located in the dst heap and
+	does not enforce ph_capacity	*/
+PH_EXPORT void
+pde_merge_heaps(PDE_HEAP *dst, PDE_HEAP *src) {
+
+	ph_merge_heaps(&dst->ph_min, &src->ph_min);
+	ph_merge_heaps(&dst->ph_max, &src->ph_max);
+	dst->ph_size += src->ph_size;
+	src->ph_size = 0;
+
+	PH_NODE *buffer = src->ph_buffer;
+	if(buffer) {
+		src->ph_buffer = NULL;
+		__pde_insert(dst, buffer);
+	}
+}
+
+/*	Invokes PH_DESTROY on every element	*/
+PH_EXPORT void
+pde_destroy_heap(PDE_HEAP *heap) {
+
+	ph_destroy_heap(&heap->ph_min);
+	ph_destroy_heap(&heap->ph_max);
+	PH_NODE *buffer = heap->ph_buffer;
+	heap->ph_buffer = NULL;
+	heap->ph_size = 0;
+	if(buffer)
+		PH_DESTROY(&heap->ph_min, buffer);
+}
+#endif
@@ -0,0 +1,56 @@
+#ifndef PHEAP_KEY_H
+#define PHEAP_KEY_H
+
+/*	This file contains the batched key compares used by the first pairing
+	pass when nodes carry an inline key. The mode is enabled by defining PH_KEY
+	before including PHEAP_V1.h or PHEAP_V2.h:
+
+		#define PH_KEY(node) ((node)->key)
+
+	the key is int32_t by default, define PH_KEY_INT64 or PH_KEY_FLOAT for
+	int64_t or float keys. The inline key mode always builds a min-queue,
+	PH_ISGREATER compares the keys in every pass and cannot be overridden.
+
+	Keys of a batch are compared into a mask with scalar code and the pairs
+	are linked with pointer selects, so random keys cause no mispredicted
+	branches	*/
+
+#include <stdint.h>
+
+#ifndef PH_KEY_TYPE
+#if defined(PH_KEY_INT64)
+#define PH_KEY_TYPE int64_t
+#elif defined(PH_KEY_FLOAT)
+#define PH_KEY_TYPE float
+#else
+#define PH_KEY_TYPE int32_t
+#endif
+#endif
+
+/*	Number of pairs gathered before the links are performed	*/
+#ifndef PH_KEY_BATCH
+#define PH_KEY_BATCH 8
+#endif
+
+#if PH_KEY_BATCH > 32
+#error "PH_KEY_BATCH must not exceed 32"
+#endif
+
+/*	Returns a mask with bit i set when odd[i] is smaller than even[i]. The
+	compares are collected without branches, the links depend on the mask	*/
+PH_INTERNAL_EXPORT unsigned
+__ph_key_mask(const PH_KEY_TYPE *even, const PH_KEY_TYPE *odd, unsigned n) {
+
+	unsigned mask = 0;
+	for(unsigned i = 0; i < n; ++i)
+		mask |= (unsigned)(odd[i] < even[i]) << i;
+	return mask;
+}
+
+/*	Branch-free select of the winner (mask bit set) and the loser of a pair	*/
+#define PH_KEY_SELECT(bit, A, B, W, L) do { \
+	uintptr_t __a = (uintptr_t)(A), __d = (__a ^ (uintptr_t)(B)) & -(uintptr_t)(bit); \
+	(W) = (PH_NODE *)(__a ^ __d); \
+	(L) = (PH_NODE *)((uintptr_t)(B) ^ __d); \
+} while(0)
+#endif
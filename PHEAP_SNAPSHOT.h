@@ -0,0 +1,150 @@
+#ifndef PHEAP_SNAPSHOT_H
+#define PHEAP_SNAPSHOT_H
+
+/*	This file contains heap snapshots stored in a flat file, include it after
+	PHEAP_V1.h or PHEAP_V2.h. All nodes of the heap must live in a single
+	index-addressable array, the array is written verbatim together with its
+	address. ph_restore maps the file back at that address, so the nodes are
+	used in place without any fix-ups. If the address range is taken, every
+	link is rebased once by the distance between the two mappings.
+
+	available operations:
+	ph_snapshot, ph_restore, ph_release
+
+	The mapping is private, changes made after ph_restore are not written
+	back to the file. POSIX mmap is required.
+
+	Some definitions can be overridden, define PARAM_DEFINED to indicate a modification	*/
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PH_SNAPSHOT_MAGIC "PHSNAP1"
+
+/*	Rebases pointers of a node moved by delta bytes. A node holding
+	other pointers into the array must provide its own definition	*/
+#ifndef PH_SNAPSHOT_REBASE
+#define __PH_REBASE(ptr, delta) \
+	((ptr) = (ptr) ? (PH_NODE *)((char *)(ptr) + (delta)) : NULL)
+#ifdef PH_PARENT_PTR
+#define PH_SNAPSHOT_REBASE(node, delta) do { \
+	__PH_REBASE((node)->ph_list, delta); \
+	__PH_REBASE((node)->ph_child, delta); \
+	__PH_REBASE((node)->ph_parent, delta); \
+} while(0)
+#else
+#define PH_SNAPSHOT_REBASE(node, delta) do { \
+	__PH_REBASE((node)->ph_list, delta); \
+	__PH_REBASE((node)->ph_child, delta); \
+} while(0)
+#endif
+#endif
+
+/*	File header, the node array starts at ph_offset, which keeps the array
+	at the same offset within a page as it had in memory	*/
+typedef struct ph_snapshot_header {
+	char ph_magic[8];
+	uint64_t ph_base, ph_offset, ph_count, ph_size, ph_root;
+} PH_SNAPSHOT_HEADER;
+
+/*	Restored snapshot	*/
+typedef struct ph_snapshot {
+	void *ph_map;
+	size_t ph_length;
+	PH_NODE *ph_nodes;
+	size_t ph_count;
+} PH_SNAPSHOT;
+
+PH_INTERNAL_EXPORT int
+__ph_write_all(int fd, const void *buf, size_t len) {
+
+	for(const char *ptr = buf; len; ) {
+		ssize_t ret = write(fd, ptr, len);
+		if(ret < 0) return -1;
+		ptr += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+/*	Writes count nodes starting at nodes and the heap root to path.
+	Returns 0 on success, -1 on failure with errno set	*/
+PH_EXPORT int
+ph_snapshot(PH_HEAP *heap, PH_NODE *nodes, size_t count, const char *path) {
+
+	size_t page = sysconf(_SC_PAGESIZE);
+	PH_SNAPSHOT_HEADER hdr = {
+		.ph_magic = PH_SNAPSHOT_MAGIC,
+		.ph_base = (uintptr_t)nodes,
+		.ph_offset = page + (uintptr_t)nodes % page,
+		.ph_count = count,
+		.ph_size = sizeof(PH_NODE),
+		.ph_root = heap->ph_root ? (uint64_t)(heap->ph_root - nodes) : UINT64_MAX,
+	};
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) return -1;
+
+	int err = __ph_write_all(fd, &hdr, sizeof(hdr))
+		|| lseek(fd, hdr.ph_offset, SEEK_SET) < 0
+		|| __ph_write_all(fd, nodes, count * sizeof(PH_NODE));
+	if(close(fd)) err = 1;
+	return err ? -1 : 0;
+}
+
+/*	Maps a snapshot and stores its root in heap, nodes are available
+	in snap->ph_nodes. Returns 0 on success, -1 on failure	*/
+PH_EXPORT int
+ph_restore(PH_SNAPSHOT *snap, PH_HEAP *heap, const char *path) {
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return -1;
+
+	PH_SNAPSHOT_HEADER hdr;
+	struct stat st;
+	if(read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || fstat(fd, &st)
+		|| memcmp(hdr.ph_magic, PH_SNAPSHOT_MAGIC, sizeof(hdr.ph_magic))
+		|| hdr.ph_size != sizeof(PH_NODE)
+		|| hdr.ph_offset < sizeof(hdr) || (uint64_t)st.st_size < hdr.ph_offset
+		|| hdr.ph_count > ((uint64_t)st.st_size - hdr.ph_offset) / hdr.ph_size) {
+		close(fd);
+		return -1;
+	}
+
+	/*	Ask for the address the nodes had, the kernel treats it as a hint	*/
+	size_t length = st.st_size;
+	char *want = (char *)(uintptr_t)hdr.ph_base - hdr.ph_offset;
+	char *map = mmap(want, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return -1;
+
+	PH_NODE *nodes = (PH_NODE *)(map + hdr.ph_offset);
+	if(map != want) {
+		intptr_t delta = (intptr_t)map - (intptr_t)want;
+		for(size_t i = 0; i < hdr.ph_count; ++i)
+			PH_SNAPSHOT_REBASE(nodes + i, delta);
+	}
+
+	snap->ph_map = map;
+	snap->ph_length = length;
+	snap->ph_nodes = nodes;
+	snap->ph_count = hdr.ph_count;
+	heap->ph_root = hdr.ph_root < hdr.ph_count ? nodes + hdr.ph_root : NULL;
+	return 0;
+}
+
+/*	Unmaps a restored snapshot, nodes cannot be used afterwards	*/
+PH_EXPORT void
+ph_release(PH_SNAPSHOT *snap) {
+
+	if(snap->ph_map)
+		munmap(snap->ph_map, snap->ph_length);
+	snap->ph_map = NULL;
+	snap->ph_nodes = NULL;
+	snap->ph_count = 0;
+}
+#endif
@@ -0,0 +1,201 @@
+#ifndef PHEAP_TIMER_H
+#define PHEAP_TIMER_H
+
+/*	This file contains a timer scheduler built on PHEAP_V2.h.
+
+	Timers due within PT_WHEEL_SIZE ticks are kept in a timing wheel, one
+	doubly linked list per tick, later timers are kept in the heap. Arming
+	is O(1) in both tiers, cancelling a wheel timer is O(1) and a heap timer
+	is removed with ph_remove_at. A timer moved to an earlier expiry inside
+	the heap uses the O(1) ph_decrease_key, a later expiry uses ph_decrease_at.
+	pt_expire detaches every timer due at the given time in one call, wheel
+	slots are spliced whole.
+
+	available operations:
+	pt_init, pt_arm, pt_cancel, pt_reschedule, pt_expire, pt_next
+
+	Time is counted in ticks of any unit and never goes backwards. Every
+	node must be passed to pt_init before it is first used, a zeroed node
+	looks like a timer in wheel slot 0, e.g.
+
+		PT_SCHED sched = { .ph_now = now() };
+		pt_init(&timer);
+
+	Some definitions can be overridden, define PARAM_DEFINED to indicate a modification	*/
+
+#include <stdint.h>
+
+/*	Intrusive PH_NODE structure, a user defined node must provide the
+	ph_expiry and ph_slot fields	*/
+#ifndef PH_NODE_DEFINED
+typedef struct ph_node {
+	struct ph_node *ph_list, *ph_child, *ph_parent;
+	uint64_t ph_expiry;
+	uint32_t ph_slot;
+} PH_NODE;
+#define PH_NODE_DEFINED
+#endif
+
+/*	Timers are ordered by expiry, the comparator is not used	*/
+#ifndef PH_ISGREATER
+#define PH_ISGREATER(ph_heap, A, B) ((A)->ph_expiry < (B)->ph_expiry)
+#endif
+
+#include "PHEAP_V2.h"
+
+/*	Number of wheel slots as a power of two	*/
+#ifndef PT_WHEEL_BITS
+#define PT_WHEEL_BITS 8
+#endif
+#define PT_WHEEL_SIZE (1u << PT_WHEEL_BITS)
+
+/*	ph_slot of timers outside the wheel, wheel timers hold the slot index	*/
+#define PT_IDLE UINT32_MAX
+#define PT_HEAP (UINT32_MAX - 1)
+
+/*	Scheduler structure, ph_now is the first tick not expired yet.
+	Wheel lists are linked through ph_list and ph_parent	*/
+#ifndef PT_SCHED_DEFINED
+typedef struct pt_sched {
+	PH_HEAP ph_heap;
+	PH_NODE *ph_wheel[PT_WHEEL_SIZE];
+	uint64_t ph_now;
+	size_t ph_count;
+} PT_SCHED;
+#define PT_SCHED_DEFINED
+#endif
+
+PH_INTERNAL_EXPORT void
+__pt_link(PT_SCHED *sched, PH_NODE *node) {
+
+	uint64_t expiry = node->ph_expiry;
+	if(expiry < sched->ph_now)
+		expiry = node->ph_expiry = sched->ph_now;
+	if(expiry - sched->ph_now >= PT_WHEEL_SIZE) {
+		node->ph_slot = PT_HEAP;
+		ph_push_raw(&sched->ph_heap, node);
+		return;
+	}
+
+	uint32_t slot = expiry & (PT_WHEEL_SIZE - 1);
+	PH_NODE *head = sched->ph_wheel[slot];
+	node->ph_slot = slot;
+	node->ph_list = head;
+	node->ph_parent = NULL;
+	if(head)
+		head->ph_parent = node;
+	sched->ph_wheel[slot] = node;
+}
+
+PH_INTERNAL_EXPORT void
+__pt_unlink(PT_SCHED *sched, PH_NODE *node) {
+
+	if(node->ph_slot == PT_HEAP) {
+		ph_remove_at(&sched->ph_heap, node);
+		return;
+	}
+	PH_NODE *next = node->ph_list, *prev = node->ph_parent;
+	if(prev)
+		prev->ph_list = next;
+	else sched->ph_wheel[node->ph_slot] = next;
+	if(next)
+		next->ph_parent = prev;
+}
+
+/*	Marks a new node as an idle timer, required before the first use	*/
+PH_EXPORT void
+pt_init(PH_NODE *node) {
+
+	node->ph_slot = PT_IDLE;
+}
+
+/*	Arms an idle timer, an expiry in the past fires at the next pt_expire	*/
+PH_EXPORT void
+pt_arm(PT_SCHED *sched, PH_NODE *node, uint64_t expiry) {
+
+	node->ph_expiry = expiry;
+	__pt_link(sched, node);
+	++sched->ph_count;
+}
+
+/*	Disarms a timer, idle timers are ignored	*/
+PH_EXPORT void
+pt_cancel(PT_SCHED *sched, PH_NODE *node) {
+
+	if(node->ph_slot == PT_IDLE) return;
+	__pt_unlink(sched, node);
+	node->ph_slot = PT_IDLE;
+	--sched->ph_count;
+}
+
+/*	Moves an armed timer to a new expiry, idle timers are armed	*/
+PH_EXPORT void
+pt_reschedule(PT_SCHED *sched, PH_NODE *node, uint64_t expiry) {
+
+	if(node->ph_slot == PT_IDLE)
+		return pt_arm(sched, node, expiry);
+
+	if(node->ph_slot == PT_HEAP && expiry >= sched->ph_now
+		&& expiry - sched->ph_now >= PT_WHEEL_SIZE) {
+		uint64_t old = node->ph_expiry;
+		node->ph_expiry = expiry;
+		if(expiry <= old)
+			ph_decrease_key(&sched->ph_heap, node);
+		else ph_decrease_at(&sched->ph_heap, node);
+		return;
+	}
+	__pt_unlink(sched, node);
+	node->ph_expiry = expiry;
+	__pt_link(sched, node);
+}
+
+/*	Detaches all timers due at now or earlier and advances the wheel.
+	Returns them as a list linked through ph_list, the timers are idle	*/
+PH_EXPORT PH_NODE *
+pt_expire(PT_SCHED *sched, uint64_t now) {
+
+	PH_NODE *list = NULL;
+	if(now < sched->ph_now) return NULL;
+
+	/*	Every wheel timer is due at its slot within the next PT_WHEEL_SIZE ticks	*/
+	uint64_t ticks = now - sched->ph_now + 1;
+	if(ticks > PT_WHEEL_SIZE) ticks = PT_WHEEL_SIZE;
+	for(uint64_t tick = sched->ph_now; tick < sched->ph_now + ticks; ++tick) {
+		PH_NODE **slot = sched->ph_wheel + (tick & (PT_WHEEL_SIZE - 1)),
+			*head = *slot, *node = head;
+		if(! head) continue;
+		*slot = NULL;
+		for(;; node = node->ph_list) {
+			node->ph_slot = PT_IDLE;
+			--sched->ph_count;
+			if(! node->ph_list) break;
+		}
+		node->ph_list = list;
+		list = head;
+	}
+	sched->ph_now = now + 1;
+
+	PH_HEAP *heap = &sched->ph_heap;
+	for(PH_NODE *root; (root = heap->ph_root) && root->ph_expiry <= now; ) {
+		heap->ph_root = __ph_pop(heap, root);
+		root->ph_slot = PT_IDLE;
+		root->ph_list = list;
+		list = root;
+		--sched->ph_count;
+	}
+	return list;
+}
+
+/*	Returns the earliest expiry, UINT64_MAX when no timer is armed	*/
+PH_EXPORT uint64_t
+pt_next(const PT_SCHED *sched) {
+
+	PH_NODE *root = sched->ph_heap.ph_root;
+	uint64_t next = root ? root->ph_expiry : UINT64_MAX;
+	for(uint64_t tick = sched->ph_now; tick < next && tick - sched->ph_now < PT_WHEEL_SIZE; ++tick) {
+		if(sched->ph_wheel[tick & (PT_WHEEL_SIZE - 1)])
+			return tick;
+	}
+	return next;
+}
+#endif
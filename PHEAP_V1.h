@@ -4,7 +4,8 @@
 /*	This file contains an implementation of a pairing heap without a parent pointer.
 
 	available operations:
-	ph_push, ph_push_raw, ph_pop, ph_decrease_root, ph_merge_heaps, ph_destroy_heap
+	ph_push, ph_push_raw, ph_pop, ph_decrease_root, ph_merge_heaps, ph_destroy_heap,
+	ph_extract_if, ph_foreach, ph_iter_init, ph_iter_next, ph_peek_k
 
 	Some definitions can be overridden, define PARAM_DEFINED to indicate a modification	*/
 
@@ -45,7 +46,14 @@ typedef struct ph_heap {
 #endif
 
 /*	Macro to control element comparison. By default 
-	the pairing heap functions as a min-queue	*/
+	the pairing heap functions as a min-queue. The inline key mode
+	orders every pass by PH_KEY ascending, see PHEAP_KEY.h	*/
+#ifdef PH_KEY
+#ifdef PH_ISGREATER
+#error "PH_ISGREATER cannot be overridden together with PH_KEY"
+#endif
+#define PH_ISGREATER(ph_heap, A, B) (PH_KEY(A) < PH_KEY(B))
+#endif
 #ifndef PH_ISGREATER
 #define PH_ISGREATER(ph_heap, A, B) (PH_GET_CMP(ph_heap)((A), (B)) < 0)
 #endif
@@ -60,6 +68,39 @@ typedef struct ph_heap {
 #define PH_INTERNAL_EXPORT inline static
 #endif
 
+/*	Software prefetching of upcoming siblings in __ph_extract_list and
+	__ph_destroy_subheap, PH_PREFETCH_DISTANCE is the number of siblings
+	walked ahead of the first pairing pass, 0 compiles prefetching out	*/
+#ifndef PH_PREFETCH_DISTANCE
+#define PH_PREFETCH_DISTANCE 0
+#endif
+
+#ifndef PH_PREFETCH
+#define PH_PREFETCH(ptr) (__builtin_prefetch(ptr))
+#endif
+
+#define __PH_PREFETCH_NODE(node) do { \
+	PH_PREFETCH((node)->ph_child); \
+	PH_PREFETCH((node)->ph_list); \
+} while(0)
+
+/*	Sibling look-ahead of the DSW walks, the walk consumes the sibling chain
+	of list in order. ahead runs up to PH_PREFETCH_DISTANCE nodes in front,
+	dist counts the prefetched nodes not consumed yet	*/
+#define __PH_PREFETCH_CHAIN(ahead, dist, list) do { \
+	if(! (dist)) (ahead) = (list); \
+	for(int __n = (dist) < PH_PREFETCH_DISTANCE ? 2 : 1; (ahead) && __n; --__n, ++(dist)) { \
+		__PH_PREFETCH_NODE(ahead); \
+		(ahead) = (ahead)->ph_list; \
+	} \
+	--(dist); \
+} while(0)
+
+/*	Inline key mode, see PHEAP_KEY.h	*/
+#ifdef PH_KEY
+#include "PHEAP_KEY.h"
+#endif
+
 PH_INTERNAL_EXPORT PH_NODE *
 __ph_push(PH_HEAP *heap, PH_NODE *root, PH_NODE *node) {
 
@@ -107,12 +148,82 @@ ph_push_raw(PH_HEAP *heap, PH_NODE *node) {
 	} else heap->ph_root = __ph_push_raw(heap, root, node);
 }
 
+#ifdef PH_KEY
+/*	First pass of the pairing algorithm for inline keys. Pairs are gathered
+	in batches, winners are computed with a single compare mask and linked
+	without branching on the keys. Returns the last root, the remaining
+	winners are stored in *plist in reverse order	*/
+PH_INTERNAL_EXPORT PH_NODE *
+__ph_first_pass_key(PH_NODE *root, PH_NODE **plist) {
+
+	PH_NODE *list = NULL;
+#if PH_PREFETCH_DISTANCE
+	PH_NODE *ahead = root;
+	for(int i = 0; ahead && i < PH_PREFETCH_DISTANCE; ++i)
+		ahead = ahead->ph_list;
+#endif
+	for(;;) {
+		PH_NODE *even[PH_KEY_BATCH], *odd[PH_KEY_BATCH], *node = root, *B;
+		PH_KEY_TYPE ekey[PH_KEY_BATCH], okey[PH_KEY_BATCH];
+		unsigned n = 0;
+		while(n < PH_KEY_BATCH && (B = node->ph_list)) {
+#if PH_PREFETCH_DISTANCE
+			for(int i = 0; ahead && i < 2; ++i) {
+				__PH_PREFETCH_NODE(ahead);
+				ahead = ahead->ph_list;
+			}
+#endif
+			even[n] = node;
+			odd[n] = B;
+			ekey[n] = PH_KEY(node);
+			okey[n] = PH_KEY(B);
+			++n;
+			if(! (node = B->ph_list)) break;
+		}
+
+		unsigned mask = __ph_key_mask(ekey, okey, n);
+		for(unsigned i = 0; i < n; ++i) {
+			PH_NODE *w, *l;
+			PH_KEY_SELECT(mask >> i & 1, even[i], odd[i], w, l);
+			l->ph_list = w->ph_child;
+			w->ph_child = l;
+			w->ph_list = list;
+			list = w;
+		}
+
+		if(! node) {
+			root = list;
+			list = list->ph_list;
+			break;
+		}
+		root = node;
+		if(! node->ph_list) break;
+	}
+	*plist = list;
+	return root;
+}
+#endif
+
 /*	Two pass merge pairing algorithm	*/
 PH_EXPORT PH_NODE *
 __ph_extract_list(PH_HEAP *heap, PH_NODE *root) {
 
 	PH_NODE *list = NULL;
+#ifdef PH_KEY
+	root = __ph_first_pass_key(root, &list);
+#else
+#if PH_PREFETCH_DISTANCE
+	PH_NODE *ahead = root;
+	for(int i = 0; ahead && i < PH_PREFETCH_DISTANCE; ++i)
+		ahead = ahead->ph_list;
+#endif
 	for(;;) {
+#if PH_PREFETCH_DISTANCE
+		for(int i = 0; ahead && i < 2; ++i) {
+			__PH_PREFETCH_NODE(ahead);
+			ahead = ahead->ph_list;
+		}
+#endif
 		PH_NODE *B = root->ph_list;
 		if(! B) break;
 		PH_NODE *C = B->ph_list;
@@ -128,6 +239,7 @@ __ph_extract_list(PH_HEAP *heap, PH_NODE *root) {
 		list = root;
 		root = C;
 	}
+#endif
 
 	while(list) {
 		PH_NODE *C = list->ph_list;
@@ -186,14 +298,24 @@ PH_INTERNAL_EXPORT void
 __ph_destroy_subheap(PH_HEAP *heap, PH_NODE *node) {
 
 	PH_NODE *list;
+#if PH_PREFETCH_DISTANCE
+	PH_NODE *ahead = NULL;
+	int dist = 0;
+#endif
 	do {
 		while((list = node->ph_list)) {
+#if PH_PREFETCH_DISTANCE
+			__PH_PREFETCH_CHAIN(ahead, dist, list);
+#endif
 			node->ph_list = list->ph_child;
 			list->ph_child = node;
 			node = list;
 		}
 		list = node;
 		node = node->ph_child;
+#if PH_PREFETCH_DISTANCE
+		PH_PREFETCH(node);
+#endif
 		PH_DESTROY(heap, list);
 	} while(node);
 }
@@ -208,6 +330,206 @@ ph_destroy_heap(PH_HEAP *heap) {
 	return __ph_destroy_subheap(heap, root);
 }
 
+/*	Predicate function prototype for ph_extract_if	*/
+#ifndef PH_PRED_DEFINED
+typedef int (*PH_PRED)(const PH_NODE *const, void *);
+#define PH_PRED_DEFINED
+#endif
+
+/*	Moves every node matching pred into out, pred is called once per node.
+	A matching node is cut out and its children take its place in the
+	sibling list, the links between the remaining nodes are kept. Only when
+	the root matches are the subheaps left at the top paired again. The walk
+	threads the last child of each visited list back to its parent through
+	ph_list (Morris traversal). Returns the number of moved nodes	*/
+PH_EXPORT size_t
+ph_extract_if(PH_HEAP *heap, PH_PRED pred, void *arg, PH_HEAP *out) {
+
+	PH_NODE *node = heap->ph_root, *owner = NULL, *last = NULL, *next;
+	PH_NODE **pptr = &heap->ph_root;
+	size_t count = 0;
+	if(! node) return 0;
+	node->ph_list = NULL;
+	while(node) {
+#if PH_PREFETCH_DISTANCE
+		__PH_PREFETCH_NODE(node);
+#endif
+		/*	A thread on the last child means the children are done	*/
+		if(node->ph_child) {
+			for(last = node->ph_child; last->ph_list && last->ph_list != node; last = last->ph_list);
+			if(last->ph_list) {
+				last->ph_list = NULL;
+				owner = NULL;
+				pptr = &node->ph_list;
+				node = *pptr;
+				continue;
+			}
+		}
+
+		if(! pred(node, arg)) {
+			if(node->ph_child) {
+				last->ph_list = node;
+				owner = node;
+				pptr = &node->ph_child;
+			} else {
+				owner = NULL;
+				pptr = &node->ph_list;
+			}
+			node = *pptr;
+			continue;
+		}
+
+		next = node->ph_list;
+		if(node->ph_child) {
+			last->ph_list = next;
+			*pptr = node->ph_child;
+		} else if(! owner || next != owner)
+			*pptr = next;
+		else {
+			/*	The only child was a leaf, its thread leads back to owner	*/
+			owner->ph_child = NULL;
+			pptr = &owner->ph_list;
+			owner = NULL;
+		}
+		ph_push_raw(out, node);
+		++count;
+		node = *pptr;
+	}
+
+	if((node = heap->ph_root) && node->ph_list)
+		heap->ph_root = __ph_extract_list(heap, node);
+	return count;
+}
+
+/*	Visitor function prototype for ph_foreach	*/
+#ifndef PH_VISIT_DEFINED
+typedef void (*PH_VISIT)(PH_NODE *, void *);
+#define PH_VISIT_DEFINED
+#endif
+
+/*	Returned by ph_foreach when the stack is too small for the walk	*/
+#define PH_FOREACH_TRUNCATED ((size_t)-1)
+
+/*	Calls fn for every node in heap order of the links, not in priority order.
+	Next siblings wait in caller provided storage while a child list is walked,
+	the heap is only read and fn must not modify it. The stack holds at most
+	one node per level, a capacity of the heap depth suffices. Returns the
+	number of visited nodes, or PH_FOREACH_TRUNCATED when the stack was full
+	and the walk stopped early	*/
+PH_EXPORT size_t
+ph_foreach(PH_HEAP *heap, PH_VISIT fn, void *arg, PH_NODE **stack, size_t capacity) {
+
+	PH_NODE *node = heap->ph_root, *next;
+	size_t count = 0, depth = 0;
+	if(! node) return 0;
+	fn(node, arg);
+	++count;
+	for(node = node->ph_child; node || depth; node = next) {
+		if(! node) node = stack[--depth];
+		fn(node, arg);
+		++count;
+		next = node->ph_list;
+		if(node->ph_child) {
+			if(next) {
+				if(depth == capacity) return PH_FOREACH_TRUNCATED;
+				stack[depth++] = next;
+			}
+			next = node->ph_child;
+		}
+	}
+	return count;
+}
+
+/*	Ordered iterator, the frontier is a binary heap of node pointers in caller
+	provided storage. ph_last is expanded lazily by the next call	*/
+#ifndef PH_ITER_DEFINED
+typedef struct ph_iter {
+	PH_HEAP *ph_heap;
+	PH_NODE **ph_frontier, *ph_last;
+	size_t ph_count, ph_capacity;
+} PH_ITER;
+#define PH_ITER_DEFINED
+#endif
+
+PH_INTERNAL_EXPORT void
+__ph_frontier_push(PH_ITER *iter, PH_NODE *node) {
+
+	PH_NODE **frontier = iter->ph_frontier;
+	size_t i = iter->ph_count++, parent;
+	for(; i; i = parent) {
+		parent = (i - 1) / 2;
+		if(! PH_ISGREATER(iter->ph_heap, node, frontier[parent])) break;
+		frontier[i] = frontier[parent];
+	}
+	frontier[i] = node;
+}
+
+PH_INTERNAL_EXPORT PH_NODE *
+__ph_frontier_pop(PH_ITER *iter) {
+
+	PH_NODE **frontier = iter->ph_frontier, *top = frontier[0],
+		*last = frontier[--iter->ph_count];
+	size_t i = 0, n = iter->ph_count, child;
+	while((child = 2 * i + 1) < n) {
+		if(child + 1 < n && PH_ISGREATER(iter->ph_heap, frontier[child + 1], frontier[child]))
+			++child;
+		if(! PH_ISGREATER(iter->ph_heap, frontier[child], last)) break;
+		frontier[i] = frontier[child];
+		i = child;
+	}
+	frontier[i] = last;
+	return top;
+}
+
+/*	Starts an ordered walk, the heap must not change until it ends. A capacity
+	of the heap size always suffices, the frontier only holds unvisited nodes	*/
+PH_EXPORT void
+ph_iter_init(PH_ITER *iter, PH_HEAP *heap, PH_NODE **frontier, size_t capacity) {
+
+	iter->ph_heap = heap;
+	iter->ph_frontier = frontier;
+	iter->ph_capacity = capacity;
+	iter->ph_count = 0;
+	iter->ph_last = NULL;
+	if(heap->ph_root && capacity)
+		__ph_frontier_push(iter, heap->ph_root);
+}
+
+/*	Returns the next node in priority order, the children of a returned node
+	enter the frontier on the next call. Returns NULL when all nodes were
+	visited or when they do not fit, ph_last is not NULL then	*/
+PH_EXPORT PH_NODE *
+ph_iter_next(PH_ITER *iter) {
+
+	PH_NODE *node = iter->ph_last, *child;
+	if(node) {
+		size_t count = iter->ph_count;
+		for(child = node->ph_child; child; child = child->ph_list)
+			++count;
+		if(count > iter->ph_capacity) return NULL;
+		for(child = node->ph_child; child; child = child->ph_list)
+			__ph_frontier_push(iter, child);
+	}
+	return iter->ph_last = iter->ph_count
+		? __ph_frontier_pop(iter)
+		: NULL;
+}
+
+/*	Stores the first k nodes in priority order into out without touching the
+	heap. Returns the number of stored nodes, less than k when the heap is
+	smaller or the frontier is full	*/
+PH_EXPORT size_t
+ph_peek_k(PH_HEAP *heap, PH_NODE **out, size_t k, PH_NODE **frontier, size_t capacity) {
+
+	PH_ITER iter;
+	PH_NODE *node;
+	size_t n = 0;
+	ph_iter_init(&iter, heap, frontier, capacity);
+	while(n < k && (node = ph_iter_next(&iter)))
+		out[n++] = node;
+	return n;
+}
+
 PH_INTERNAL_EXPORT PH_NODE *
 __ph_merge(PH_HEAP *heap, PH_NODE *root1, PH_NODE *root2) {
 
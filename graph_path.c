@@ -0,0 +1,590 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*	Shortest paths on weighted graphs stored in compressed sparse rows
+	Compilation: cc -O2 graph_path.c -lm
+
+	Usage: ./a.out [-A] [-s source] [-t target] <graph.gr> [graph.co]
+	Reads a DIMACS shortest path graph, nodes are numbered from 1.
+	-s -t searches one-to-one with Dijkstra, -A uses A* with the node
+	coordinates of the .co file. Without -t the search is one-to-all.
+	./a.out -g n [-o prefix] generates an n x n road-like grid instead of
+	reading files, -o writes it as prefix.gr and prefix.co.
+	-b benchmarks random queries on the graph and reports the time per
+	settled node.
+
+	Every node embeds a PHEAP_V2.h node, a shorter path to a queued node
+	updates it in place with ph_decrease_at. Labels are valid only when
+	their stamp matches the generation of the query, so a new query does
+	not clear the arrays. A search settles nodes until all of its targets
+	are settled or the smallest key exceeds its bound.	*/
+
+typedef uint64_t DISTANCE;
+#define INF UINT64_MAX
+#define NONE UINT32_MAX
+
+/*	Heap node of a graph node, the index of the node is the graph node	*/
+typedef struct node {
+	struct node *ph_list, *ph_child, *ph_parent;
+	DISTANCE key;
+} NODE;
+typedef NODE PH_NODE;
+#define PH_NODE_DEFINED
+
+/*	Comparator function prototype	*/
+typedef int (*PH_CMP)(const PH_NODE *const, const PH_NODE *const);
+#define PH_CMP_DEFINED
+
+static int
+cmp(const PH_NODE *const p1, const PH_NODE *const p2) {
+	return (p1->key > p2->key) - (p1->key < p2->key);
+}
+
+/*	Graph in compressed sparse rows, arcs of node v are first[v] ..
+	first[v + 1] - 1. Coordinates are optional	*/
+typedef struct graph {
+	uint32_t nodes, arcs;
+	uint32_t *first, *head, *weight;
+	int32_t *x, *y;
+	double scale;
+} GRAPH;
+
+/*	Search state definition as PH_HEAP. A node is labelled when its
+	stamp is 2 * generation and settled when it is 2 * generation + 1.
+	With astar set one-to-one queries use the coordinates	*/
+typedef struct search {
+	PH_NODE *ph_root;
+	PH_CMP ph_cmp;
+	const GRAPH *graph;
+	NODE *nodes;
+	DISTANCE *distance;
+	uint32_t *from, *stamp, generation;
+	uint32_t target;
+	int astar;
+	size_t settled;
+} SEARCH;
+typedef SEARCH PH_HEAP;
+#define PH_HEAP_DEFINED
+
+/*	Nodes belong to the search and are never released one by one	*/
+#define PH_DESTROY(ph_heap, node)
+
+#include "PHEAP_V2.h"
+
+#define LABELLED(search) ((search)->generation * 2)
+#define SETTLED(search) ((search)->generation * 2 + 1)
+
+/*	Arc list used while building the graph	*/
+typedef struct arc {
+	uint32_t tail, head, weight;
+} ARC;
+
+/*	Sorts the arcs by tail into the rows, arcs are released	*/
+static int
+graph_build(GRAPH *graph, ARC *arcs) {
+
+	graph->first = calloc((size_t)graph->nodes + 1, sizeof(uint32_t));
+	graph->head = malloc((size_t)graph->arcs * sizeof(uint32_t));
+	graph->weight = malloc((size_t)graph->arcs * sizeof(uint32_t));
+	if(! graph->first || ! graph->head || ! graph->weight) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		free(arcs);
+		return EXIT_FAILURE;
+	}
+
+	for(uint32_t i = 0; i < graph->arcs; ++i)
+		++graph->first[arcs[i].tail + 1];
+	for(uint32_t v = 0; v < graph->nodes; ++v)
+		graph->first[v + 1] += graph->first[v];
+	for(uint32_t i = 0; i < graph->arcs; ++i) {
+		uint32_t pos = graph->first[arcs[i].tail]++;
+		graph->head[pos] = arcs[i].head;
+		graph->weight[pos] = arcs[i].weight;
+	}
+	for(uint32_t v = graph->nodes; v > 0; --v)
+		graph->first[v] = graph->first[v - 1];
+	graph->first[0] = 0;
+	free(arcs);
+	return EXIT_SUCCESS;
+}
+
+/*	Loads a DIMACS .gr file: "p sp n m" and "a u v w" lines	*/
+static int
+load_gr(GRAPH *graph, const char *path) {
+
+	FILE *file = fopen(path, "r");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	ARC *arcs = NULL;
+	uint32_t count = 0;
+	int err = 0;
+	char line[256];
+	while(fgets(line, sizeof(line), file)) {
+		unsigned long long n, m, u, v, w;
+		if(line[0] == 'p') {
+			if(arcs || sscanf(line, "p sp %llu %llu", &n, &m) != 2
+				|| n >= NONE || m > UINT32_MAX) {
+				fprintf(stderr, "Invalid problem line in %s\n", path);
+				err = 1;
+				break;
+			}
+			graph->nodes = n;
+			graph->arcs = m;
+			if(! (arcs = malloc((m ? m : 1) * sizeof(ARC)))) {
+				fprintf(stderr, "Memory allocation failed (malloc)\n");
+				err = 1;
+				break;
+			}
+		} else if(line[0] == 'a') {
+			if(! arcs || count == graph->arcs
+				|| sscanf(line, "a %llu %llu %llu", &u, &v, &w) != 3
+				|| ! u || u > graph->nodes || ! v || v > graph->nodes || w > UINT32_MAX) {
+				fprintf(stderr, "Invalid arc %u in %s\n", count + 1, path);
+				err = 1;
+				break;
+			}
+			arcs[count++] = (ARC){ u - 1, v - 1, w };
+		}
+	}
+	/*	Parse errors have already been reported	*/
+	if(! err) {
+		if((err = ferror(file)))
+			fprintf(stderr, "Cannot read %s\n", path);
+		else if((err = ! arcs))
+			fprintf(stderr, "Missing problem line in %s\n", path);
+		else if((err = count != graph->arcs))
+			fprintf(stderr, "Invalid arc count in %s\n", path);
+	}
+	fclose(file);
+	if(err) {
+		free(arcs);
+		return EXIT_FAILURE;
+	}
+	return graph_build(graph, arcs);
+}
+
+/*	The A* heuristic is the Euclidean distance times the smallest ratio
+	of arc weight and arc length, which keeps it consistent	*/
+static void
+graph_scale(GRAPH *graph) {
+
+	graph->scale = INFINITY;
+	for(uint32_t v = 0; v < graph->nodes; ++v) {
+		for(uint32_t i = graph->first[v]; i < graph->first[v + 1]; ++i) {
+			uint32_t u = graph->head[i];
+			double length = hypot((double)graph->x[v] - graph->x[u],
+				(double)graph->y[v] - graph->y[u]);
+			if(length > 0 && graph->weight[i] / length < graph->scale)
+				graph->scale = graph->weight[i] / length;
+		}
+	}
+	if(graph->scale == INFINITY) graph->scale = 0;
+}
+
+/*	Loads a DIMACS .co file: "v id x y" lines	*/
+static int
+load_co(GRAPH *graph, const char *path) {
+
+	FILE *file = fopen(path, "r");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return EXIT_FAILURE;
+	}
+	graph->x = malloc((size_t)graph->nodes * sizeof(int32_t));
+	graph->y = malloc((size_t)graph->nodes * sizeof(int32_t));
+	if(! graph->x || ! graph->y) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		fclose(file);
+		return EXIT_FAILURE;
+	}
+
+	uint32_t count = 0;
+	char line[256];
+	while(fgets(line, sizeof(line), file)) {
+		unsigned long long id;
+		long x, y;
+		if(line[0] != 'v') continue;
+		if(sscanf(line, "v %llu %ld %ld", &id, &x, &y) != 3 || ! id || id > graph->nodes) {
+			fprintf(stderr, "Invalid coordinates in %s\n", path);
+			fclose(file);
+			return EXIT_FAILURE;
+		}
+		graph->x[id - 1] = x;
+		graph->y[id - 1] = y;
+		++count;
+	}
+	fclose(file);
+	if(count != graph->nodes) {
+		fprintf(stderr, "Missing coordinates in %s\n", path);
+		return EXIT_FAILURE;
+	}
+	graph_scale(graph);
+	return EXIT_SUCCESS;
+}
+
+/*	Road-like n x n grid: nodes are jittered around grid points, most
+	neighbours are joined in both directions and the weight is the arc
+	length times a random slowdown of up to 2	*/
+static int
+graph_generate(GRAPH *graph, uint32_t n) {
+
+	if(! n || (uint64_t)n * n >= NONE / 4) {
+		fprintf(stderr, "Invalid grid size\n");
+		return EXIT_FAILURE;
+	}
+	graph->nodes = n * n;
+	graph->x = malloc((size_t)graph->nodes * sizeof(int32_t));
+	graph->y = malloc((size_t)graph->nodes * sizeof(int32_t));
+	ARC *arcs = malloc((size_t)graph->nodes * 4 * sizeof(ARC));
+	if(! graph->x || ! graph->y || ! arcs) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		free(arcs);
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+	for(uint32_t v = 0; v < graph->nodes; ++v) {
+		graph->x[v] = v % n * 1000 + rand() % 400;
+		graph->y[v] = v / n * 1000 + rand() % 400;
+	}
+	uint32_t count = 0;
+	for(uint32_t v = 0; v < graph->nodes; ++v) {
+		uint32_t next[2] = { v % n + 1 < n ? v + 1 : NONE, v + n < graph->nodes ? v + n : NONE };
+		for(int i = 0; i < 2; ++i) {
+			uint32_t u = next[i];
+			if(u == NONE || rand() % 10 == 0) continue;
+			double length = hypot((double)graph->x[v] - graph->x[u],
+				(double)graph->y[v] - graph->y[u]);
+			uint32_t weight = length * (1 + rand() % 1000 / 1000.0);
+			arcs[count++] = (ARC){ v, u, weight };
+			arcs[count++] = (ARC){ u, v, weight };
+		}
+	}
+	graph->arcs = count;
+	if(graph_build(graph, arcs) == EXIT_FAILURE)
+		return EXIT_FAILURE;
+	graph_scale(graph);
+	return EXIT_SUCCESS;
+}
+
+/*	Writes the graph as prefix.gr and prefix.co	*/
+static int
+graph_store(const GRAPH *graph, const char *prefix) {
+
+	size_t length = strlen(prefix);
+	char *path = malloc(length + 4);
+	if(! path) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
+	}
+	int err = 0;
+	for(int co = 0; co < 2 && ! err; ++co) {
+		memcpy(path, prefix, length);
+		memcpy(path + length, co ? ".co" : ".gr", 4);
+		FILE *file = fopen(path, "w");
+		if(! file) {
+			fprintf(stderr, "Cannot open %s\n", path);
+			err = 1;
+			break;
+		}
+		if(co) {
+			fprintf(file, "p aux sp co %u\n", graph->nodes);
+			for(uint32_t v = 0; v < graph->nodes; ++v)
+				fprintf(file, "v %u %d %d\n", v + 1, graph->x[v], graph->y[v]);
+		} else {
+			fprintf(file, "p sp %u %u\n", graph->nodes, graph->arcs);
+			for(uint32_t v = 0; v < graph->nodes; ++v) {
+				for(uint32_t i = graph->first[v]; i < graph->first[v + 1]; ++i)
+					fprintf(file, "a %u %u %u\n", v + 1, graph->head[i] + 1, graph->weight[i]);
+			}
+		}
+		if(fclose(file)) {
+			fprintf(stderr, "Cannot write %s\n", path);
+			err = 1;
+		}
+	}
+	free(path);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void
+graph_free(GRAPH *graph) {
+
+	free(graph->first);
+	free(graph->head);
+	free(graph->weight);
+	free(graph->x);
+	free(graph->y);
+}
+
+static int
+search_init(SEARCH *search, const GRAPH *graph) {
+
+	size_t n = graph->nodes;
+	*search = (SEARCH){
+		.ph_cmp = cmp,
+		.graph = graph,
+		.nodes = malloc(n * sizeof(NODE)),
+		.distance = malloc(n * sizeof(DISTANCE)),
+		.from = malloc(n * sizeof(uint32_t)),
+		.stamp = calloc(n, sizeof(uint32_t)),
+	};
+	if(search->nodes && search->distance && search->from && search->stamp)
+		return EXIT_SUCCESS;
+	fprintf(stderr, "Memory allocation failed (malloc)\n");
+	return EXIT_FAILURE;
+}
+
+static void
+search_free(SEARCH *search) {
+
+	free(search->nodes);
+	free(search->distance);
+	free(search->from);
+	free(search->stamp);
+}
+
+/*	Starts a new generation, the stamps are cleared when it wraps	*/
+static void
+search_reset(SEARCH *search, uint32_t target) {
+
+	search->ph_root = NULL;
+	search->settled = 0;
+	search->target = target;
+	if(++search->generation > UINT32_MAX / 2 - 1) {
+		memset(search->stamp, 0, search->graph->nodes * sizeof(uint32_t));
+		search->generation = 1;
+	}
+}
+
+/*	A* estimate of the remaining distance, 0 for Dijkstra	*/
+static inline DISTANCE
+estimate(const SEARCH *search, uint32_t v) {
+
+	const GRAPH *graph = search->graph;
+	if(search->target == NONE || ! search->astar) return 0;
+	uint32_t t = search->target;
+	return graph->scale * hypot((double)graph->x[v] - graph->x[t],
+		(double)graph->y[v] - graph->y[t]);
+}
+
+/*	Labels v with a path of length distance, queued nodes are updated in place	*/
+static inline void
+relax(SEARCH *search, uint32_t v, DISTANCE distance, uint32_t from) {
+
+	uint32_t stamp = search->stamp[v];
+	NODE *node = search->nodes + v;
+	if(stamp == LABELLED(search)) {
+		if(distance >= search->distance[v]) return;
+		node->key -= search->distance[v] - distance;
+		search->distance[v] = distance;
+		search->from[v] = from;
+		ph_decrease_at(search, node);
+		return;
+	}
+	if(stamp == SETTLED(search)) return;
+	search->stamp[v] = LABELLED(search);
+	search->distance[v] = distance;
+	search->from[v] = from;
+	node->key = distance + estimate(search, v);
+	ph_push_raw(search, node);
+}
+
+/*	Which nodes a search settles	*/
+typedef enum scope {
+	SCOPE_TARGETS,	/*	stop once the targets are settled	*/
+	SCOPE_ALL	/*	settle every reachable node, targets are ignored	*/
+} SCOPE;
+
+/*	Settles nodes from source until the scope is done or the smallest
+	distance exceeds bound. A single target enables the A* estimate	*/
+static void
+shortest_paths(SEARCH *search, uint32_t source, SCOPE scope,
+	const uint32_t *targets, size_t count, DISTANCE bound) {
+
+	const GRAPH *graph = search->graph;
+	if(scope == SCOPE_ALL) count = 0;
+	search_reset(search, count == 1 ? targets[0] : NONE);
+	relax(search, source, 0, NONE);
+
+	size_t pending = count;
+	for(NODE *top; (scope == SCOPE_ALL || pending) && (top = search->ph_root); ) {
+		uint32_t v = top - search->nodes;
+		DISTANCE distance = search->distance[v];
+		if(distance > bound) break;
+
+		ph_pop(search);
+		search->stamp[v] = SETTLED(search);
+		++search->settled;
+		for(size_t i = 0; i < count; ++i)
+			pending -= targets[i] == v;
+
+		for(uint32_t i = graph->first[v]; i < graph->first[v + 1]; ++i)
+			relax(search, graph->head[i], distance + graph->weight[i], v);
+	}
+}
+
+/*	One-to-one query	*/
+static DISTANCE
+one_to_one(SEARCH *search, uint32_t source, uint32_t target) {
+
+	shortest_paths(search, source, SCOPE_TARGETS, &target, 1, INF);
+	return search->stamp[target] == SETTLED(search) ? search->distance[target] : INF;
+}
+
+/*	One-to-all query	*/
+static void
+one_to_all(SEARCH *search, uint32_t source) {
+
+	shortest_paths(search, source, SCOPE_ALL, NULL, 0, INF);
+}
+
+static double
+now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+compare_distance(const void *a, const void *b) {
+
+	DISTANCE x = *(const DISTANCE *)a, y = *(const DISTANCE *)b;
+	return (x > y) - (x < y);
+}
+
+/*	Random one-to-one queries with Dijkstra and A*, one-to-all queries
+	and queries bounded by the median one-to-one distance	*/
+static void
+benchmark(SEARCH *search, int astar) {
+
+	enum { QUERIES = 64 };
+	const GRAPH *graph = search->graph;
+	uint32_t pairs[QUERIES][2];
+	DISTANCE found[QUERIES], sorted[QUERIES];
+
+	srand(2);
+	for(int i = 0; i < QUERIES; ++i) {
+		pairs[i][0] = ((uint64_t)rand() * RAND_MAX + rand()) % graph->nodes;
+		pairs[i][1] = ((uint64_t)rand() * RAND_MAX + rand()) % graph->nodes;
+	}
+	printf("%u nodes, %u arcs\n", graph->nodes, graph->arcs);
+
+	const char *names[] = { "dijkstra one-to-one", "a* one-to-one", "one-to-all", "bounded" };
+	for(int mode = 0; mode < 4; ++mode) {
+		if(mode == 1 && ! astar) continue;
+		search->astar = mode == 1;
+		size_t settled = 0, queries = mode == 2 ? QUERIES / 8 : QUERIES;
+		double t0 = now();
+		for(size_t i = 0; i < queries; ++i) {
+			uint32_t source = pairs[i][0], target = pairs[i][1];
+			switch(mode) {
+				case 0:
+					found[i] = one_to_one(search, source, target);
+					break;
+				case 1:
+					if(one_to_one(search, source, target) != found[i])
+						fprintf(stderr, "A* distance differs from Dijkstra\n");
+					break;
+				case 2:
+					one_to_all(search, source);
+					break;
+				default:
+					shortest_paths(search, source, SCOPE_ALL, NULL, 0, sorted[QUERIES / 2]);
+			}
+			settled += search->settled;
+		}
+		double time = now() - t0;
+		printf("%20s: %.1f ns per settled node, %zu settled per query\n",
+			names[mode], settled ? time / settled : 0, settled / queries);
+		if(! mode) {
+			memcpy(sorted, found, sizeof(found));
+			qsort(sorted, QUERIES, sizeof(DISTANCE), compare_distance);
+		}
+	}
+}
+
+int
+main(int argc, char *argv[]) {
+
+	const char *prefix = NULL;
+	unsigned long source = 0, target = 0, grid = 0;
+	int astar = 0, bench = 0, usage = 0;
+	for(int opt; (opt = getopt(argc, argv, "As:t:bg:o:")) != -1; ) {
+		switch(opt) {
+			case 'A': astar = 1; break;
+			case 's': source = strtoul(optarg, NULL, 10); break;
+			case 't': target = strtoul(optarg, NULL, 10); break;
+			case 'b': bench = 1; break;
+			case 'g': grid = strtoul(optarg, NULL, 10); break;
+			case 'o': prefix = optarg; break;
+			default: usage = 1;
+		}
+	}
+	int files = argc - optind;
+	if(usage || (grid ? files : files < 1 || files > 2) || (astar && ! grid && files < 2)
+		|| (! bench && ! prefix && ! source)) {
+		fprintf(stderr, "Usage: %s [-A] [-b] [-s source] [-t target] "
+			"(<graph.gr> [graph.co] | -g n [-o prefix])\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	GRAPH graph = { 0 };
+	int err = grid
+		? graph_generate(&graph, grid)
+		: load_gr(&graph, argv[optind]) == EXIT_FAILURE
+			|| (files == 2 && load_co(&graph, argv[optind + 1]) == EXIT_FAILURE);
+	if(! err && prefix)
+		err = graph_store(&graph, prefix);
+	if(err) {
+		graph_free(&graph);
+		return EXIT_FAILURE;
+	}
+	SEARCH search;
+	if(search_init(&search, &graph) == EXIT_FAILURE) {
+		search_free(&search);
+		graph_free(&graph);
+		return EXIT_FAILURE;
+	}
+
+	search.astar = astar;
+	if(bench)
+		benchmark(&search, astar);
+	else if(source) {
+		if(source > graph.nodes || target > graph.nodes) {
+			fprintf(stderr, "Invalid node\n");
+			err = 1;
+		} else if(target) {
+			DISTANCE distance = one_to_one(&search, source - 1, target - 1);
+			if(distance == INF) printf("No path found\n");
+			else {
+				size_t hops = 0;
+				for(uint32_t v = target - 1; v != source - 1; v = search.from[v]) ++hops;
+				printf("Found path, distance: %llu, arcs: %zu\n", (unsigned long long)distance, hops);
+			}
+			printf("Settled nodes: %zu\n", search.settled);
+		} else {
+			one_to_all(&search, source - 1);
+			DISTANCE max = 0;
+			for(uint32_t v = 0; v < graph.nodes; ++v) {
+				if(search.stamp[v] == SETTLED(&search) && search.distance[v] > max)
+					max = search.distance[v];
+			}
+			printf("Settled nodes: %zu, largest distance: %llu\n",
+				search.settled, (unsigned long long)max);
+		}
+	}
+
+	search_free(&search);
+	graph_free(&graph);
+	return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,245 @@
+#ifndef MAZE_FORMAT_H
+#define MAZE_FORMAT_H
+
+/*	This file contains the maze formats shared by maze_solver.c and
+	maze_replan.c, together with their bitset and direction helpers.
+
+	Text format, one line per row:
+	wall: 'X'
+	open path: ' '
+	start point: 'S'
+	end point: 'E'
+
+	The binary format is a header followed by the wall bitset, it is
+	mapped without parsing. create_maze recognizes both formats, the
+	walls are writable in either case (a private mapping)	*/
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef struct pair {
+	unsigned int x, y;
+} PAIR;
+
+/*	Bitset helpers	*/
+typedef uint64_t BITS;
+#define BITS_WORDS(n) (((n) + 63) >> 6)
+#define BIT_GET(set, i) ((set)[(i) >> 6] >> ((i) & 63) & 1)
+#define BIT_SET(set, i) ((set)[(i) >> 6] |= (BITS)1 << ((i) & 63))
+#define BIT_CLR(set, i) ((set)[(i) >> 6] &= ~((BITS)1 << ((i) & 63)))
+#define BIT_FLIP(set, i) ((set)[(i) >> 6] ^= (BITS)1 << ((i) & 63))
+
+/*	Move directions, stored in 2 bits per cell, four cells per byte	*/
+enum direction {
+	LEFT,
+	RIGHT,
+	DOWN,
+	UP,
+};
+#define DIR_SHIFT(i) (((i) & 3) << 1)
+#define DIR_GET(dirs, i) ((dirs)[(i) >> 2] >> DIR_SHIFT(i) & 3)
+#define DIR_SET(dirs, i, dir) ((dirs)[(i) >> 2] = \
+	((dirs)[(i) >> 2] & ~(3 << DIR_SHIFT(i))) | (dir) << DIR_SHIFT(i))
+
+/*	Maze grid, cells are stored row by row: x is the row, y the column.
+	Missing start or end points are SIZE_MAX	*/
+typedef struct maze {
+	PAIR dimensions;
+	size_t size, start, end;
+	BITS *wall;
+	void *map;
+	size_t map_length;
+} MAZE;
+
+/*	Binary maze format: header followed by the wall bitset, which is
+	used directly from the mapped file	*/
+#define MAZE_MAGIC "PHMAZE1"
+
+typedef struct maze_header {
+	char magic[8];
+	uint32_t x, y;
+	uint64_t start, end;
+} MAZE_HEADER;
+
+/*	ORs n bits into a zeroed bitset at position pos	*/
+static void
+put_bits(BITS *set, size_t pos, BITS bits, unsigned int n) {
+
+	unsigned int shift = pos & 63;
+	set[pos >> 6] |= bits << shift;
+	if(shift + n > 64)
+		set[(pos >> 6) + 1] |= bits >> (64 - shift);
+}
+
+static int
+parse_cell(MAZE *maze, char c, size_t cell) {
+
+	switch(c) {
+		case 'X': BIT_SET(maze->wall, cell); break;
+		case ' ': break;
+		case 'S': maze->start = cell; break;
+		case 'E': maze->end = cell; break;
+		default:
+			fprintf(stderr, "Invalid character [%c]\n", c);
+			return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*	Classifies 16 characters per step, rows with an unexpected
+	character fall back to the scalar loop which reports it	*/
+static int
+parse_row(MAZE *maze, const char *row, unsigned int len) {
+
+	size_t base = maze->size;
+	unsigned int i = 0;
+#ifdef __SSE2__
+	const __m128i wall = _mm_set1_epi8('X'), open = _mm_set1_epi8(' '),
+		start = _mm_set1_epi8('S'), end = _mm_set1_epi8('E');
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+		unsigned int w = _mm_movemask_epi8(_mm_cmpeq_epi8(v, wall)),
+			o = _mm_movemask_epi8(_mm_cmpeq_epi8(v, open)),
+			se = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, start),
+				_mm_cmpeq_epi8(v, end)));
+		if((w | o | se) != 0xFFFF) break;
+		if(w) put_bits(maze->wall, base + i, w, 16);
+		for(; se; se &= se - 1) {
+			unsigned int bit = __builtin_ctz(se);
+			parse_cell(maze, row[i + bit], base + i + bit);
+		}
+	}
+#endif
+	for(; i < len; ++i) {
+		if(parse_cell(maze, row[i], base + i) == EXIT_FAILURE)
+			return EXIT_FAILURE;
+	}
+	maze->size += len;
+	return EXIT_SUCCESS;
+}
+
+static int
+load_text(MAZE *maze, const char *data, size_t len) {
+
+	/*	Every character is at most one cell, one word of slack for put_bits	*/
+	if(! (maze->wall = calloc(BITS_WORDS(len) + 1, sizeof(BITS)))) {
+		fprintf(stderr, "Memory allocation failed (calloc)\n");
+		return EXIT_FAILURE;
+	}
+
+	for(const char *row = data, *stop = data + len; row < stop; ) {
+		const char *eol = memchr(row, '\n', stop - row);
+		if(! eol) eol = stop;
+		size_t rowlen = eol - row;
+		if(rowlen != maze->dimensions.y) {
+			if(maze->dimensions.y) {
+				fprintf(stderr, "Invalid maze dimensions\n");
+				return EXIT_FAILURE;
+			}
+			maze->dimensions.y = rowlen;
+		}
+		if(maze->size + rowlen > UINT_MAX) {
+			fprintf(stderr, "Maze too large\n");
+			return EXIT_FAILURE;
+		}
+		if(parse_row(maze, row, rowlen) == EXIT_FAILURE)
+			return EXIT_FAILURE;
+		++maze->dimensions.x;
+		row = eol + 1;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int
+load_binary(MAZE *maze, char *map, size_t len) {
+
+	const MAZE_HEADER *hdr = (const MAZE_HEADER *)map;
+	size_t size = (size_t)hdr->x * hdr->y;
+	if(size > UINT_MAX || len < sizeof(MAZE_HEADER) + BITS_WORDS(size) * sizeof(BITS)) {
+		fprintf(stderr, "Invalid maze dimensions\n");
+		munmap(map, len);
+		return EXIT_FAILURE;
+	}
+	maze->dimensions = (PAIR){ hdr->x, hdr->y };
+	maze->size = size;
+	maze->start = hdr->start < size ? hdr->start : SIZE_MAX;
+	maze->end = hdr->end < size ? hdr->end : SIZE_MAX;
+	maze->wall = (BITS *)(map + sizeof(MAZE_HEADER));
+	maze->map = map;
+	maze->map_length = len;
+	return EXIT_SUCCESS;
+}
+
+/*	Function for mapping the maze file and creating runtime data,
+	binary mazes are recognized by their magic	*/
+static int
+create_maze(MAZE *maze, int fd) {
+
+	maze->start = maze->end = SIZE_MAX;
+
+	struct stat st;
+	if(fstat(fd, &st) || ! st.st_size) {
+		fprintf(stderr, "Empty maze\n");
+		return EXIT_FAILURE;
+	}
+	size_t len = st.st_size;
+	char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if(map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map the maze file (mmap)\n");
+		return EXIT_FAILURE;
+	}
+
+	if(len >= sizeof(MAZE_HEADER) && ! memcmp(map, MAZE_MAGIC, sizeof(MAZE_MAGIC)))
+		return load_binary(maze, map, len);
+
+	madvise(map, len, MADV_SEQUENTIAL);
+	int err = load_text(maze, map, len);
+	munmap(map, len);
+	return err;
+}
+
+/*	Writes the maze in the binary format	*/
+static int
+store_maze(const MAZE *maze, const char *path) {
+
+	MAZE_HEADER hdr = {
+		.magic = MAZE_MAGIC,
+		.x = maze->dimensions.x,
+		.y = maze->dimensions.y,
+		.start = maze->start,
+		.end = maze->end,
+	};
+	FILE *file = fopen(path, "wb");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return EXIT_FAILURE;
+	}
+	size_t words = BITS_WORDS(maze->size);
+	int err = fwrite(&hdr, sizeof(hdr), 1, file) != 1
+		|| fwrite(maze->wall, sizeof(BITS), words, file) != words;
+	if(fclose(file) || err) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*	Releases the walls, mapped mazes are unmapped	*/
+static void
+maze_free(MAZE *maze) {
+
+	if(maze->map)
+		munmap(maze->map, maze->map_length);
+	else free(maze->wall);
+}
+
+#endif
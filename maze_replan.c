@@ -0,0 +1,641 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "maze_format.h"
+
+/*	Incremental replanning with Lifelong Planning A* (LPA*)
+	Compilation: cc -O2 maze_replan.c
+
+	Usage: ./a.out <maze_file> [changes.txt]
+	The maze is a text or binary maze of maze_format.h. Every line of the changes file
+	toggles the wall at "x y" (row, column), an empty line ends a batch.
+	The path is replanned after each batch and only cells whose distance
+	depends on the changed walls are expanded again.
+	./a.out -b <maze_file.txt> compares replanning after k random wall
+	toggles with the initial plan.
+
+	./a.out -f <field.bin> [-q queries.txt] <maze_file.txt> [changes.txt]
+	keeps a distance field of E: the distance of every cell to E and the
+	direction of its next hop. The field is flooded once from E (LPA*
+	without a goal and with h = 0 is Dijkstra), stored in field.bin and
+	mapped from there by later runs as long as the maze file and E match.
+	Changes repair the field locally and it is stored again together with
+	the changed walls, later runs continue from those walls. Every query
+	line "x y" is answered by a lookup and a walk along the next hops,
+	the output is "x y distance path" with the path as L/R/D/U moves.
+
+	Every cell embeds a PHEAP_V2.h node. A cell whose g and rhs values
+	disagree is queued under the key (min(g, rhs) + h, min(g, rhs)),
+	when a change reaches a queued cell it is updated in place with
+	ph_decrease_at or dropped with ph_remove_at.	*/
+
+typedef uint32_t DISTANCE;
+#define INF UINT32_MAX
+
+/*	Heap node of a cell, the index of the node is the cell	*/
+typedef struct node {
+	struct node *ph_list, *ph_child, *ph_parent;
+	DISTANCE k1, k2;
+} NODE;
+typedef NODE PH_NODE;
+#define PH_NODE_DEFINED
+
+/*	Comparator function prototype	*/
+typedef int (*PH_CMP)(const PH_NODE *const, const PH_NODE *const);
+#define PH_CMP_DEFINED
+
+/*	Keys are compared lexicographically	*/
+static int
+cmp(const PH_NODE *const p1, const PH_NODE *const p2) {
+
+	if(p1->k1 != p2->k1)
+		return p1->k1 < p2->k1 ? -1 : 1;
+	return (p1->k2 > p2->k2) - (p1->k2 < p2->k2);
+}
+
+/*	Planner state definition as PH_HEAP, it is kept between replans.
+	The maze owns the walls, rows to wall repeat its fields for brevity.
+	Without a goal (end is SIZE_MAX) every reachable cell is settled,
+	dirs is used only by the distance field	*/
+typedef struct planner {
+	PH_NODE *ph_root;
+	PH_CMP ph_cmp;
+	MAZE maze;
+	unsigned int rows, columns;
+	size_t size, start, end;
+	BITS *wall, *queued;
+	DISTANCE *g, *rhs;
+	unsigned char *dirs;
+	NODE *nodes;
+	size_t expanded;
+	void *map;
+	size_t map_length;
+} PLANNER;
+typedef PLANNER PH_HEAP;
+#define PH_HEAP_DEFINED
+
+/*	Nodes belong to the nodes array and are never released one by one	*/
+#define PH_DESTROY(ph_heap, node)
+
+#include "PHEAP_V2.h"
+
+/*	Manhattan distance to the end cell	*/
+static DISTANCE
+heuristic(const PLANNER *planner, size_t cell) {
+
+	if(planner->end == SIZE_MAX) return 0;
+	unsigned int x = cell / planner->columns, y = cell % planner->columns,
+		ex = planner->end / planner->columns, ey = planner->end % planner->columns;
+	return (x > ex ? x - ex : ex - x) + (y > ey ? y - ey : ey - y);
+}
+
+static void
+calculate_key(const PLANNER *planner, size_t cell, NODE *node) {
+
+	DISTANCE g = planner->g[cell], rhs = planner->rhs[cell];
+	node->k2 = g < rhs ? g : rhs;
+	node->k1 = node->k2 == INF ? INF : node->k2 + heuristic(planner, cell);
+}
+
+/*	Stores the open neighbours of a cell, returns their number	*/
+static unsigned int
+neighbours(const PLANNER *planner, size_t cell, size_t *out) {
+
+	unsigned int n = 0, y = cell % planner->columns;
+	if(y && ! BIT_GET(planner->wall, cell - 1))
+		out[n++] = cell - 1;
+	if(y + 1 < planner->columns && ! BIT_GET(planner->wall, cell + 1))
+		out[n++] = cell + 1;
+	if(cell + planner->columns < planner->size && ! BIT_GET(planner->wall, cell + planner->columns))
+		out[n++] = cell + planner->columns;
+	if(cell >= planner->columns && ! BIT_GET(planner->wall, cell - planner->columns))
+		out[n++] = cell - planner->columns;
+	return n;
+}
+
+/*	Recomputes rhs of a cell and fixes its queue membership	*/
+static void
+update_cell(PLANNER *planner, size_t cell) {
+
+	if(cell != planner->start) {
+		DISTANCE rhs = INF;
+		if(! BIT_GET(planner->wall, cell)) {
+			size_t next[4];
+			for(unsigned int i = neighbours(planner, cell, next); i--; ) {
+				DISTANCE g = planner->g[next[i]];
+				if(g != INF && g + 1 < rhs) rhs = g + 1;
+			}
+		}
+		planner->rhs[cell] = rhs;
+	}
+
+	NODE *node = planner->nodes + cell;
+	if(planner->g[cell] != planner->rhs[cell]) {
+		calculate_key(planner, cell, node);
+		if(BIT_GET(planner->queued, cell))
+			ph_decrease_at(planner, node);
+		else {
+			BIT_SET(planner->queued, cell);
+			ph_push_raw(planner, node);
+		}
+	} else if(BIT_GET(planner->queued, cell)) {
+		BIT_CLR(planner->queued, cell);
+		ph_remove_at(planner, node);
+	}
+}
+
+static void
+update_neighbours(PLANNER *planner, size_t cell) {
+
+	size_t next[4];
+	for(unsigned int i = neighbours(planner, cell, next); i--; )
+		update_cell(planner, next[i]);
+}
+
+/*	Points a cell of the distance field at its closest neighbour	*/
+static void
+update_hop(PLANNER *planner, size_t cell) {
+
+	size_t next[4];
+	DISTANCE best = INF;
+	for(unsigned int i = neighbours(planner, cell, next); i--; ) {
+		if(planner->g[next[i]] >= best) continue;
+		best = planner->g[next[i]];
+		DIR_SET(planner->dirs, cell, next[i] == cell - 1 ? LEFT
+			: next[i] == cell + 1 ? RIGHT
+			: next[i] > cell ? DOWN : UP);
+	}
+}
+
+/*	A changed g value can redirect the cell and its neighbours	*/
+static void
+update_hops(PLANNER *planner, size_t cell) {
+
+	size_t next[4];
+	update_hop(planner, cell);
+	for(unsigned int i = neighbours(planner, cell, next); i--; )
+		update_hop(planner, next[i]);
+}
+
+/*	Expands queued cells until the end cell is consistent and no
+	queued key is smaller than its key, without a goal until the
+	queue is empty	*/
+static void
+compute_path(PLANNER *planner) {
+
+	size_t end = planner->end;
+	for(NODE *top; (top = planner->ph_root); ) {
+
+		if(end != SIZE_MAX) {
+			NODE goal;
+			calculate_key(planner, end, &goal);
+			if(cmp(top, &goal) >= 0 && planner->g[end] == planner->rhs[end])
+				break;
+		}
+
+		ph_pop(planner);
+		size_t cell = top - planner->nodes;
+		BIT_CLR(planner->queued, cell);
+		++planner->expanded;
+
+		if(planner->g[cell] > planner->rhs[cell]) {
+			planner->g[cell] = planner->rhs[cell];
+			update_neighbours(planner, cell);
+		} else {
+			planner->g[cell] = INF;
+			update_cell(planner, cell);
+			update_neighbours(planner, cell);
+		}
+		if(planner->dirs)
+			update_hops(planner, cell);
+	}
+}
+
+/*	Toggles a wall and queues the cells whose rhs may have changed	*/
+static int
+toggle_wall(PLANNER *planner, unsigned int x, unsigned int y) {
+
+	size_t cell = (size_t)x * planner->columns + y;
+	if(x >= planner->rows || y >= planner->columns
+		|| cell == planner->start || cell == planner->end) {
+		fprintf(stderr, "Invalid change [%u %u]\n", x, y);
+		return EXIT_FAILURE;
+	}
+	BIT_FLIP(planner->wall, cell);
+	update_cell(planner, cell);
+	update_neighbours(planner, cell);
+	return EXIT_SUCCESS;
+}
+
+/*	Loads a maze, the planner works on the walls of the maze	*/
+static int
+planner_init(PLANNER *planner, int fd) {
+
+	*planner = (PLANNER){ .ph_cmp = cmp, };
+	MAZE *maze = &planner->maze;
+	if(create_maze(maze, fd) == EXIT_FAILURE)
+		return EXIT_FAILURE;
+	if(! maze->size) {
+		fprintf(stderr, "Invalid maze dimensions\n");
+		return EXIT_FAILURE;
+	}
+	if(maze->end == SIZE_MAX) {
+		fprintf(stderr, "No endpoint specified\n");
+		return EXIT_FAILURE;
+	}
+	planner->rows = maze->dimensions.x;
+	planner->columns = maze->dimensions.y;
+	planner->size = maze->size;
+	planner->start = maze->start;
+	planner->end = maze->end;
+	planner->wall = maze->wall;
+
+	planner->queued = calloc(BITS_WORDS(planner->size), sizeof(BITS));
+	planner->g = malloc(planner->size * sizeof(DISTANCE));
+	planner->rhs = malloc(planner->size * sizeof(DISTANCE));
+	planner->nodes = malloc(planner->size * sizeof(NODE));
+	if(! planner->queued || ! planner->g || ! planner->rhs || ! planner->nodes) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*	Queues the start cell of a new plan	*/
+static void
+planner_start(PLANNER *planner) {
+
+	for(size_t i = 0; i < planner->size; ++i)
+		planner->g[i] = planner->rhs[i] = INF;
+	planner->rhs[planner->start] = 0;
+	update_cell(planner, planner->start);
+}
+
+static void
+planner_free(PLANNER *planner) {
+
+	if(planner->map)
+		munmap(planner->map, planner->map_length);
+	else {
+		free(planner->g);
+		free(planner->dirs);
+	}
+	maze_free(&planner->maze);
+	free(planner->queued);
+	free(planner->rhs);
+	free(planner->nodes);
+}
+
+/*	Distance field file: header, current walls, g values of all cells and
+	the next hop directions. The maze file the field was last used with is
+	identified by the hash of its walls	*/
+#define FIELD_MAGIC "PHFIELD"
+
+typedef struct field_header {
+	char magic[8];
+	uint32_t rows, columns;
+	uint64_t end, base;
+} FIELD_HEADER;
+
+/*	Size of a field file of size cells	*/
+#define FIELD_LENGTH(size) (sizeof(FIELD_HEADER) + BITS_WORDS(size) * sizeof(BITS) \
+	+ (size) * sizeof(DISTANCE) + (((size) + 3) >> 2))
+
+/*	FNV-1a hash of the wall bitset	*/
+static uint64_t
+hash_walls(const PLANNER *planner) {
+
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const unsigned char *bytes = (const unsigned char *)planner->wall;
+	for(size_t i = 0; i < BITS_WORDS(planner->size) * sizeof(BITS); ++i)
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	return hash;
+}
+
+/*	Maps a stored field, the g values and directions are used in place and
+	the stored walls replace those of the maze. Fails when the file is
+	missing or belongs to another maze, base is the hash of its walls	*/
+static int
+field_load(PLANNER *planner, const char *path, uint64_t base) {
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return EXIT_FAILURE;
+
+	struct stat st;
+	size_t size = planner->size, length = FIELD_LENGTH(size);
+	if(fstat(fd, &st) || (size_t)st.st_size != length) {
+		close(fd);
+		return EXIT_FAILURE;
+	}
+	char *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return EXIT_FAILURE;
+
+	/*	The maze file is the one the field was derived from, or it already
+		holds the walls of the field	*/
+	const FIELD_HEADER *hdr = (const FIELD_HEADER *)map;
+	const BITS *wall = (const BITS *)(map + sizeof(FIELD_HEADER));
+	size_t bytes = BITS_WORDS(size) * sizeof(BITS);
+	if(memcmp(hdr->magic, FIELD_MAGIC, sizeof(FIELD_MAGIC)) || hdr->rows != planner->rows
+		|| hdr->columns != planner->columns || hdr->end != planner->start
+		|| (hdr->base != base && memcmp(wall, planner->wall, bytes))) {
+		munmap(map, length);
+		return EXIT_FAILURE;
+	}
+
+	/*	A settled field is consistent, rhs equals g everywhere	*/
+	memcpy(planner->wall, wall, bytes);
+	free(planner->g);
+	planner->g = (DISTANCE *)(wall + BITS_WORDS(size));
+	planner->dirs = (unsigned char *)(planner->g + size);
+	planner->map = map;
+	planner->map_length = length;
+	memcpy(planner->rhs, planner->g, size * sizeof(DISTANCE));
+	return EXIT_SUCCESS;
+}
+
+/*	Floods the field from E	*/
+static int
+field_build(PLANNER *planner) {
+
+	if(! (planner->dirs = calloc((planner->size + 3) >> 2, 1))) {
+		fprintf(stderr, "Memory allocation failed (calloc)\n");
+		return EXIT_FAILURE;
+	}
+	planner_start(planner);
+	compute_path(planner);
+	return EXIT_SUCCESS;
+}
+
+/*	Writes the field through a temporary file, a mapped field stays
+	valid while the file is replaced	*/
+static int
+field_store(const PLANNER *planner, const char *path, uint64_t base) {
+
+	FIELD_HEADER hdr = {
+		.magic = FIELD_MAGIC,
+		.rows = planner->rows,
+		.columns = planner->columns,
+		.end = planner->start,
+		.base = base,
+	};
+	size_t length = strlen(path);
+	char *tmp = malloc(length + 5);
+	if(! tmp) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
+	}
+	memcpy(tmp, path, length);
+	memcpy(tmp + length, ".tmp", 5);
+
+	FILE *file = fopen(tmp, "wb");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", tmp);
+		free(tmp);
+		return EXIT_FAILURE;
+	}
+	size_t size = planner->size, bytes = (size + 3) >> 2, words = BITS_WORDS(size);
+	int err = fwrite(&hdr, sizeof(hdr), 1, file) != 1
+		|| fwrite(planner->wall, sizeof(BITS), words, file) != words
+		|| fwrite(planner->g, sizeof(DISTANCE), size, file) != size
+		|| fwrite(planner->dirs, 1, bytes, file) != bytes;
+	if(fclose(file) || err || rename(tmp, path)) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		unlink(tmp);
+		free(tmp);
+		return EXIT_FAILURE;
+	}
+	free(tmp);
+	return EXIT_SUCCESS;
+}
+
+/*	Answers "x y" queries with a lookup and a walk along the next hops	*/
+static int
+field_query(const PLANNER *planner, FILE *file) {
+
+	char line[64];
+	while(fgets(line, sizeof(line), file)) {
+		unsigned int x, y;
+		if(sscanf(line, "%u %u", &x, &y) != 2) continue;
+		if(x >= planner->rows || y >= planner->columns) {
+			fprintf(stderr, "Invalid query [%u %u]\n", x, y);
+			return EXIT_FAILURE;
+		}
+		size_t cell = (size_t)x * planner->columns + y;
+		if(planner->g[cell] == INF) {
+			printf("%u %u -1\n", x, y);
+			continue;
+		}
+		printf("%u %u %u ", x, y, planner->g[cell]);
+		while(cell != planner->start) {
+			unsigned int dir = DIR_GET(planner->dirs, cell);
+			putchar("LRDU"[dir]);
+			switch(dir) {
+				case LEFT: --cell; break;
+				case RIGHT: ++cell; break;
+				case DOWN: cell += planner->columns; break;
+				default: cell -= planner->columns;
+			}
+		}
+		putchar('\n');
+	}
+	return EXIT_SUCCESS;
+}
+
+static void
+print_result(PLANNER *planner) {
+
+	if(planner->end != SIZE_MAX) {
+		if(planner->g[planner->end] != INF)
+			printf("Found path, distance: %u\n", planner->g[planner->end]);
+		else printf("No path found\n");
+	}
+	printf("Expanded cells: %zu\n", planner->expanded);
+	planner->expanded = 0;
+}
+
+/*	Applies the batches of a changes file	*/
+static int
+replan(PLANNER *planner, FILE *file) {
+
+	char line[64];
+	int pending = 0;
+	while(fgets(line, sizeof(line), file)) {
+		unsigned int x, y;
+		if(sscanf(line, "%u %u", &x, &y) == 2) {
+			if(toggle_wall(planner, x, y) == EXIT_FAILURE)
+				return EXIT_FAILURE;
+			pending = 1;
+		} else if(pending) {
+			compute_path(planner);
+			print_result(planner);
+			pending = 0;
+		}
+	}
+	if(pending) {
+		compute_path(planner);
+		print_result(planner);
+	}
+	return EXIT_SUCCESS;
+}
+
+static double
+now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*	Toggles k random cells and replans, then restores them and replans
+	again, the report shows the average cost of one replan	*/
+static void
+benchmark(PLANNER *planner) {
+
+	enum { ROUNDS = 32, MAX_CHANGES = 4096 };
+	static size_t cells[MAX_CHANGES];
+
+	double t0 = now();
+	compute_path(planner);
+	printf("%u x %u maze, initial plan: %.1f us, %zu expanded\n", planner->rows,
+		planner->columns, (now() - t0) / 1e3, planner->expanded);
+
+	srand(1);
+	for(size_t k = 1; k <= MAX_CHANGES; k *= 4) {
+		size_t expanded = 0;
+		double time = 0;
+		for(int round = 0; round < ROUNDS; ++round) {
+			for(size_t i = 0; i < k; ++i) {
+				do cells[i] = ((size_t)rand() * RAND_MAX + rand()) % planner->size;
+				while(cells[i] == planner->start || cells[i] == planner->end);
+			}
+			for(int pass = 0; pass < 2; ++pass) {
+				planner->expanded = 0;
+				t0 = now();
+				for(size_t i = 0; i < k; ++i)
+					toggle_wall(planner, cells[i] / planner->columns, cells[i] % planner->columns);
+				compute_path(planner);
+				time += now() - t0;
+				expanded += planner->expanded;
+			}
+		}
+		printf("%6zu cells changed: %.1f us, %zu expanded per replan\n",
+			k, time / (2 * ROUNDS) / 1e3, expanded / (2 * ROUNDS));
+	}
+}
+
+/*	Applies a changes file, prints an error when it cannot be opened	*/
+static int
+replan_file(PLANNER *planner, const char *path) {
+
+	FILE *file = fopen(path, "r");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return EXIT_FAILURE;
+	}
+	int err = replan(planner, file);
+	fclose(file);
+	return err;
+}
+
+/*	Distance field mode, the field is rebuilt when it cannot be mapped	*/
+static int
+run_field(PLANNER *planner, const char *path, const char *changes, const char *queries) {
+
+	uint64_t base = hash_walls(planner);
+	planner->start = planner->end;
+	planner->end = SIZE_MAX;
+	int store = 0;
+	if(field_load(planner, path, base) == EXIT_FAILURE) {
+		if(field_build(planner) == EXIT_FAILURE)
+			return EXIT_FAILURE;
+		printf("Built distance field, expanded cells: %zu\n", planner->expanded);
+		planner->expanded = 0;
+		store = 1;
+	}
+	if(changes) {
+		if(replan_file(planner, changes) == EXIT_FAILURE)
+			return EXIT_FAILURE;
+		store = 1;
+	}
+	if(store && field_store(planner, path, base) == EXIT_FAILURE)
+		return EXIT_FAILURE;
+	if(! queries) return EXIT_SUCCESS;
+
+	FILE *file = fopen(queries, "r");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", queries);
+		return EXIT_FAILURE;
+	}
+	int err = field_query(planner, file);
+	fclose(file);
+	return err;
+}
+
+int
+main(int argc, char *argv[]) {
+
+	const char *field = NULL, *queries = NULL;
+	int bench = 0, usage = 0;
+	for(int opt; (opt = getopt(argc, argv, "bf:q:")) != -1; ) {
+		switch(opt) {
+			case 'b': bench = 1; break;
+			case 'f': field = optarg; break;
+			case 'q': queries = optarg; break;
+			default: usage = 1;
+		}
+	}
+	if(usage || optind >= argc || argc - optind > 2 || (bench && (field || argc - optind > 1))
+		|| (queries && ! field)) {
+		fprintf(stderr, "Usage: %s [-b] [-f field.bin [-q queries.txt]] "
+			"<maze_file> [changes_file]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	const char *changes = argc - optind == 2 ? argv[optind + 1] : NULL;
+
+	int fd = open(argv[optind], O_RDONLY);
+	if(fd < 0) {
+		fprintf(stderr, "Cannot open %s\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	PLANNER planner;
+	int err = planner_init(&planner, fd);
+	close(fd);
+	if(err == EXIT_FAILURE) {
+		planner_free(&planner);
+		return EXIT_FAILURE;
+	}
+
+	if(field) {
+		err = run_field(&planner, field, changes, queries);
+		planner_free(&planner);
+		return err;
+	}
+
+	if(planner.start == SIZE_MAX) {
+		fprintf(stderr, "No startpoint specified\n");
+		planner_free(&planner);
+		return EXIT_FAILURE;
+	}
+	planner_start(&planner);
+
+	if(bench) {
+		benchmark(&planner);
+		planner_free(&planner);
+		return EXIT_SUCCESS;
+	}
+
+	compute_path(&planner);
+	print_result(&planner);
+	if(changes)
+		err = replan_file(&planner, changes);
+	planner_free(&planner);
+	return err;
+}
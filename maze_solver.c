@@ -1,270 +1,902 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "maze_format.h"
 
 /*	Basic A* algorithm implementation using a pairing heap queue
-	Compilation: cc maze_solver.c
+	Compilation: cc maze_solver.c -pthread
 
 	Usage: ./a.out <maze_file.txt>
 	Provide a text file containing the maze as a command-line argument.
+	./a.out -o <maze.bin> <maze_file.txt> converts the maze into the
+	binary format, which is mapped without parsing and accepted in place
+	of a text file.
+	-j searches with Jump Point Search, only jump points are queued.
+	-J uses JPS+, horizontal jump distances are precomputed (8 bytes per cell).
+	-b runs bidirectional A* (NBA*) from both S and E.
+	-q <queries.txt> answers a batch of queries against the loaded maze
+	instead of searching from S to E, -t <n> spreads them over n threads.
+	Every query line holds the start and end cell as "x1 y1 x2 y2" (row,
+	column), the distance is printed for each of them, -1 if unreachable.
 
 	Maze File Format:
 	wall: 'X'
 	open path: ' '
 	start point: 'S'
-	end point: 'E'	*/
-
-enum flag {
-	WALL = 1,
-	VISITED = 2,
-	TOP = 4,
-	OPEN = 8,
-	PATH = 16,
-};
+	end point: 'E'
 
-typedef struct pair {
-	unsigned int x, y;
-} PAIR;
+	Memory layout: walls and the opened/closed state live in bitsets,
+	g-scores in a dense array and predecessors as 2-bit directions, about
+	4.5 bytes per cell. Heap nodes are allocated only for opened cells.
+	The opened/closed words carry a generation stamp, a new query bumps
+	the generation instead of clearing them.	*/
 
 typedef unsigned int DISTANCE;
 
 /*	heuristic function prototype	*/
-typedef DISTANCE (*MH)(PAIR *, PAIR *);
-
-/*  Let’s embed all necessary path data inside PH_NODE	*/
-typedef struct cell {
-	struct cell *ph_child, *ph_list, *ph_parent;
-	DISTANCE fscore, distance;
-	struct cell *from;
-	unsigned int flag;
-} CELL;
-typedef CELL PH_NODE;
+typedef DISTANCE (*MH)(const PAIR *, const PAIR *);
+
+/*	Search modes	*/
+enum mode {
+	ASTAR,
+	JPS,
+	JPS_PLUS,
+};
+
+#define NONE SIZE_MAX
+
+/*	Per-query bitset, a word written in an older generation reads as zero.
+	Generation 0 is never used by a query	*/
+typedef uint16_t STAMP;
+
+typedef struct flags {
+	BITS *bits;
+	STAMP *stamp;
+} FLAGS;
+
+static inline BITS
+flag_word(const FLAGS *flags, STAMP generation, size_t word) {
+	return flags->stamp[word] == generation ? flags->bits[word] : 0;
+}
+
+static inline BITS *
+flag_touch(FLAGS *flags, STAMP generation, size_t word) {
+
+	if(flags->stamp[word] != generation) {
+		flags->stamp[word] = generation;
+		flags->bits[word] = 0;
+	}
+	return flags->bits + word;
+}
+
+#define FLAG_GET(search, set, i) \
+	(flag_word(&(search)->set, (search)->generation, (i) >> 6) >> ((i) & 63) & 1)
+#define FLAG_SET(search, set, i) \
+	(*flag_touch(&(search)->set, (search)->generation, (i) >> 6) |= (BITS)1 << ((i) & 63))
+#define FLAG_CLR(search, set, i) \
+	(*flag_touch(&(search)->set, (search)->generation, (i) >> 6) &= ~((BITS)1 << ((i) & 63)))
+
+/*	Heap node, exists only while a cell is queued	*/
+typedef struct node {
+	struct node *ph_list, *ph_child;
+	DISTANCE fscore;
+	unsigned int cell;
+} NODE;
+typedef NODE PH_NODE;
 #define PH_NODE_DEFINED
 
 /*  Using Manhattan distance as the heuristic function */
 static DISTANCE
-mh(PAIR *point1, PAIR *point2) {
-	return abs(point1->x - point2->x) + abs(point1->y - point2->y);
+mh(const PAIR *point1, const PAIR *point2) {
+	return (point1->x > point2->x ? point1->x - point2->x : point2->x - point1->x)
+		+ (point1->y > point2->y ? point1->y - point2->y : point2->y - point1->y);
 }
 
 /*	Comparator function prototype	*/
 typedef int (*PH_CMP)(const PH_NODE *const, const PH_NODE *const);
 
-/*	Comparator function	*/
+/*	Comparator function, the lowest fscore is on top	*/
 int
 cmp(const PH_NODE *const p1, const PH_NODE *const p2) {
-	return (int)p2->fscore - (int)p1->fscore;
+	return (p1->fscore > p2->fscore) - (p1->fscore < p2->fscore);
 }
 #define PH_CMP_DEFINED
 
-/*	Main data structure definition as PH_HEAP	*/
-typedef struct data {
+/*	Heap nodes are taken from chunks and recycled through a free list	*/
+#define POOL_CHUNK 4096
+
+typedef struct pool {
+	struct pool *next;
+	NODE nodes[POOL_CHUNK];
+} POOL;
+
+/*	Search state definition as PH_HEAP	*/
+typedef struct search {
 	PH_NODE *ph_root;
 	PH_CMP ph_cmp;
 	MH mh;
-	PAIR startpoint, endpoint, dimensions;
-	CELL *ptr;
-	size_t size;
-} DATA;
-typedef DATA PH_HEAP;
+	const MAZE *maze;
+	size_t start, end;
+	PAIR endpoint;
+	FLAGS open, closed;
+	STAMP generation;
+	DISTANCE *distance;
+	unsigned char *from;
+	POOL *pool;
+	size_t used;
+	NODE *free;
+	size_t expanded, pushes, queued;
+	int (*expand)(struct search *, size_t, PAIR *);
+	const int *jumps;
+	struct search *other;
+	DISTANCE length;
+	size_t meet;
+} SEARCH;
+typedef SEARCH PH_HEAP;
 #define PH_HEAP_DEFINED
 
-#include "PHEAP_V2.h"
+static NODE *
+node_alloc(SEARCH *search) {
+
+	NODE *node = search->free;
+	if(node) {
+		search->free = node->ph_list;
+		return node;
+	}
+	if(! search->pool || search->used == POOL_CHUNK) {
+		POOL *pool = malloc(sizeof(POOL));
+		if(! pool) return NULL;
+		pool->next = search->pool;
+		search->pool = pool;
+		search->used = 0;
+	}
+	return search->pool->nodes + search->used++;
+}
 
 static void
-add(DATA *data, CELL *current, PAIR *cpoint, PAIR *npoint) {
+node_free(SEARCH *search, NODE *node) {
 
-	CELL *neighbour = data->ptr + (npoint->x * data->dimensions.y + npoint->y);
+	node->ph_list = search->free;
+	search->free = node;
+}
 
-	if(neighbour->flag & (WALL | VISITED)) return;
-	
-	DISTANCE distance = current->distance + 1;
-	if(neighbour->flag & TOP) {
-		if(distance >= neighbour->distance) return;
-		ph_remove_at(data, neighbour);
-	} else neighbour->flag |= TOP;
+/*	Queued nodes are recycled when a search is reset	*/
+#define PH_DESTROY(ph_heap, node) node_free(ph_heap, node)
 
-	neighbour->distance = distance;
-	neighbour->fscore = data->mh(&data->endpoint, npoint) + distance;
-	neighbour->from = current;
-	ph_push_raw(data, neighbour);
+#include "PHEAP_V1.h"
+
+static PAIR
+point(const MAZE *maze, size_t cell) {
+	return (PAIR){ cell / maze->dimensions.y, cell % maze->dimensions.y };
 }
 
-static void
-make_list(DATA *data, CELL *current, PAIR *cpoint) {
+/*	Returns the cell a path came from	*/
+static size_t
+predecessor(const MAZE *maze, size_t cell, unsigned int dir) {
+
+	switch(dir) {
+		case LEFT: return cell + 1;
+		case RIGHT: return cell - 1;
+		case DOWN: return cell - maze->dimensions.y;
+		default: return cell + maze->dimensions.y;
+	}
+}
+
+/*	Queues a cell, the heap may hold outdated nodes of a cell
+	which are skipped once the cell is closed	*/
+static int
+add(SEARCH *search, size_t cell, DISTANCE distance, PAIR *npoint, unsigned int dir) {
+
+	if(BIT_GET(search->maze->wall, cell) || FLAG_GET(search, closed, cell))
+		return EXIT_SUCCESS;
+
+	if(FLAG_GET(search, open, cell)) {
+		if(distance >= search->distance[cell]) return EXIT_SUCCESS;
+	} else FLAG_SET(search, open, cell);
+
+	NODE *node = node_alloc(search);
+	if(! node) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
+	}
+	search->distance[cell] = distance;
+	DIR_SET(search->from, cell, dir);
+	node->cell = cell;
+	node->fscore = search->mh(&search->endpoint, npoint) + distance;
+	ph_push_raw(search, node);
+	++search->pushes;
+	++search->queued;
+
+	/*	Bidirectional search, cells labelled by both sides join the paths	*/
+	SEARCH *other = search->other;
+	if(other && FLAG_GET(other, open, cell) && distance + other->distance[cell] < search->length) {
+		search->length = other->length = distance + other->distance[cell];
+		search->meet = other->meet = cell;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int
+make_list(SEARCH *search, size_t cell, PAIR *cpoint) {
+
+	const MAZE *maze = search->maze;
+	DISTANCE distance = search->distance[cell] + 1;
+	int err = EXIT_SUCCESS;
 
 	/* left	*/
 	if(cpoint->y)
-		add(data, current, cpoint, &(PAIR){cpoint->x, cpoint->y - 1});
+		err |= add(search, cell - 1, distance, &(PAIR){cpoint->x, cpoint->y - 1}, LEFT);
 
 	/*	right	*/
-	if(cpoint->y + 1 < data->dimensions.y)
-		add(data, current, cpoint, &(PAIR){cpoint->x, cpoint->y + 1});
+	if(cpoint->y + 1 < maze->dimensions.y)
+		err |= add(search, cell + 1, distance, &(PAIR){cpoint->x, cpoint->y + 1}, RIGHT);
 
 	/*	down	*/
-	if(cpoint->x + 1 < data->dimensions.x)
-		add(data, current, cpoint, &(PAIR){cpoint->x + 1, cpoint->y});
+	if(cpoint->x + 1 < maze->dimensions.x)
+		err |= add(search, cell + maze->dimensions.y, distance,
+			&(PAIR){cpoint->x + 1, cpoint->y}, DOWN);
 
 	/* up	*/
 	if(cpoint->x)
-		add(data, current, cpoint, &(PAIR){cpoint->x - 1, cpoint->y});
+		err |= add(search, cell - maze->dimensions.y, distance,
+			&(PAIR){cpoint->x - 1, cpoint->y}, UP);
+
+	return err;
 }
 
-static void
-astar(DATA *data) {
+/*	Jump Point Search on the 4-connected grid. Horizontal scans stop at
+	cells with a forced vertical neighbour, vertical scans additionally stop
+	where a horizontal scan finds a jump point. JPS+ replaces horizontal
+	scans by precomputed distances: a positive value is the distance to the
+	next jump point, otherwise its negation is the number of free cells	*/
+static int
+passable(const MAZE *maze, unsigned int x, unsigned int y) {
 
-	for(CELL *current; (current = data->ph_root); ) {
+	return x < maze->dimensions.x && y < maze->dimensions.y
+		&& ! BIT_GET(maze->wall, (size_t)x * maze->dimensions.y + y);
+}
 
-		data->ph_root = __ph_pop(data, current);
-		current->flag |= VISITED;
-		current->flag &= ~TOP;
+/*	Checks a cell entered horizontally with step dy for forced neighbours	*/
+static int
+forced(const MAZE *maze, unsigned int x, unsigned int y, int dy) {
 
-		PAIR cpoint = {
-			.x = (current - data->ptr) / data->dimensions.y,
-			.y = (current - data->ptr) % data->dimensions.y,
-		};
+	return (passable(maze, x - 1, y) && ! passable(maze, x - 1, y - dy))
+		|| (passable(maze, x + 1, y) && ! passable(maze, x + 1, y - dy));
+}
 
-		if(cpoint.x == data->endpoint.x && cpoint.y == data->endpoint.y)
-			break;
-		make_list(data, current, &cpoint);
+static size_t
+jump_horizontal(const SEARCH *search, PAIR p, unsigned int dir) {
+
+	const MAZE *maze = search->maze;
+	int dy = dir == RIGHT ? 1 : -1;
+
+	if(search->jumps) {
+		int jump = search->jumps[((size_t)p.x * maze->dimensions.y + p.y) * 2 + dir];
+		unsigned int reach = jump > 0 ? jump : -jump;
+		if(search->endpoint.x == p.x) {
+			unsigned int steps = search->endpoint.y - p.y;
+			if(dir == LEFT) steps = -steps;
+			if(steps && steps <= reach)
+				return search->end;
+		}
+		return jump > 0 ? (size_t)p.x * maze->dimensions.y + p.y + dy * jump : NONE;
+	}
+
+	for(;;) {
+		p.y += dy;
+		if(! passable(maze, p.x, p.y)) return NONE;
+		size_t cell = (size_t)p.x * maze->dimensions.y + p.y;
+		if(cell == search->end || forced(maze, p.x, p.y, dy))
+			return cell;
+	}
+}
+
+static size_t
+jump(const SEARCH *search, PAIR p, unsigned int dir) {
+
+	if(dir == LEFT || dir == RIGHT)
+		return jump_horizontal(search, p, dir);
+
+	const MAZE *maze = search->maze;
+	int dx = dir == DOWN ? 1 : -1;
+	for(;;) {
+		p.x += dx;
+		if(! passable(maze, p.x, p.y)) return NONE;
+		size_t cell = (size_t)p.x * maze->dimensions.y + p.y;
+		if(cell == search->end
+			|| (passable(maze, p.x, p.y - 1) && ! passable(maze, p.x - dx, p.y - 1))
+			|| (passable(maze, p.x, p.y + 1) && ! passable(maze, p.x - dx, p.y + 1))
+			|| jump_horizontal(search, p, LEFT) != NONE
+			|| jump_horizontal(search, p, RIGHT) != NONE)
+			return cell;
 	}
 }
 
-/*	Function for parsing the maze file and creating runtime data	*/
-#define POW 5
-#define CHUNK (1 << POW)
-#define MASK (CHUNK - 1)
+/*	Queues jump points in the pruned directions, the start cell has all four	*/
+static int
+make_list_jps(SEARCH *search, size_t cell, PAIR *cpoint) {
+
+	const MAZE *maze = search->maze;
+	unsigned int dirs = 1 << LEFT | 1 << RIGHT | 1 << DOWN | 1 << UP;
+	if(cell != search->start) {
+		unsigned int dir = DIR_GET(search->from, cell);
+		dirs = dir == LEFT || dir == RIGHT
+			? 1 << dir | 1 << DOWN | 1 << UP
+			: 1 << dir | 1 << LEFT | 1 << RIGHT;
+	}
+
+	int err = EXIT_SUCCESS;
+	for(unsigned int dir = LEFT; dir <= UP; ++dir) {
+		if(! (dirs & 1 << dir)) continue;
+		size_t next = jump(search, *cpoint, dir);
+		if(next == NONE) continue;
+		PAIR npoint = point(maze, next);
+		err |= add(search, next, search->distance[cell] + mh(cpoint, &npoint), &npoint, dir);
+	}
+	return err;
+}
 
+/*	Precomputes horizontal jump distances for JPS+	*/
 static int
-create_maze(DATA *data, FILE *stream) {
-
-	for(int c, len = 0;;) {
-
-		switch((c = getc(stream))) {
-			case EOF: goto outloop;
-			case '\n':
-				if(len != data->dimensions.y) {
-					if(data->dimensions.y) {
-						fprintf(stderr, "Invalid maze dimensions\n");
-						return EXIT_FAILURE;
-					}
-					data->dimensions.y = len;
-				}
-				++data->dimensions.x; len = 0; continue;
-			case 'X': c = WALL; break;
-			case ' ': c = OPEN; break;
-			case 'S': c = OPEN; data->startpoint.y = data->size; break;
-			case 'E': c = OPEN; data->endpoint.y = data->size; break;
-			default: 
-				fprintf(stderr, "Invalid character [%c]\n", c);
-				return EXIT_FAILURE;
-		};
-		++len;
+jumps_init(const MAZE *maze, int **table) {
 
-		/*  Allocate more memory if needed  */
-		if(! (data->size & MASK)) {
-			CELL *tmp = realloc(data->ptr, (data->size + CHUNK) * sizeof(CELL));
-			if(! tmp) {
-				fprintf(stderr, "Memory allocation failed (realloc)\n");
-				return EXIT_FAILURE;
-			}
-			data->ptr = tmp;
-			memset(tmp + data->size, 0, CHUNK * sizeof(CELL));
+	int *jumps;
+	if(maze->dimensions.y > INT_MAX
+		|| ! (*table = jumps = malloc(maze->size * 2 * sizeof(int)))) {
+		fprintf(stderr, "Cannot allocate jump distances\n");
+		return EXIT_FAILURE;
+	}
+
+	unsigned int dy = maze->dimensions.y;
+	for(unsigned int x = 0; x < maze->dimensions.x; ++x) {
+		size_t row = (size_t)x * dy;
+		for(unsigned int y = 0; y < dy; ++y) {
+			int prev = y ? jumps[(row + y - 1) * 2 + LEFT] : 0;
+			jumps[(row + y) * 2 + LEFT] = ! passable(maze, x, y - 1) ? 0
+				: forced(maze, x, y - 1, -1) ? 1
+				: prev > 0 ? prev + 1 : prev - 1;
+		}
+		for(unsigned int y = dy; y-- > 0; ) {
+			int prev = y + 1 < dy ? jumps[(row + y + 1) * 2 + RIGHT] : 0;
+			jumps[(row + y) * 2 + RIGHT] = ! passable(maze, x, y + 1) ? 0
+				: forced(maze, x, y + 1, 1) ? 1
+				: prev > 0 ? prev + 1 : prev - 1;
 		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/*	Queues the first cell of a search	*/
+static int
+search_start(SEARCH *search, size_t cell) {
 
-		data->ptr[data->size].flag = c;
-		++data->size;
+	NODE *node = node_alloc(search);
+	if(! node) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
 	}
-	outloop:
+	PAIR cpoint = point(search->maze, cell);
+	node->cell = cell;
+	node->fscore = search->mh(&search->endpoint, &cpoint);
+	search->distance[cell] = 0;
+	FLAG_SET(search, open, cell);
+	ph_push_raw(search, node);
+	++search->pushes;
+	++search->queued;
+	return EXIT_SUCCESS;
+}
 
-	/*  Shrink memory to fit actual data size */
-	void *tmp = realloc(data->ptr, data->size * sizeof(CELL));
-	if(! tmp) {
-		fprintf(stderr, "Memory allocation failed (realloc)\n");
+static int
+astar(SEARCH *search) {
+
+	const MAZE *maze = search->maze;
+	if(search_start(search, search->start) == EXIT_FAILURE)
 		return EXIT_FAILURE;
+
+	for(NODE *current; (current = search->ph_root); ) {
+
+		search->ph_root = __ph_pop(search, current);
+		--search->queued;
+		size_t cell = current->cell;
+		node_free(search, current);
+
+		if(FLAG_GET(search, closed, cell)) continue;
+		FLAG_SET(search, closed, cell);
+		FLAG_CLR(search, open, cell);
+		++search->expanded;
+
+		if(cell == search->end)
+			break;
+
+		PAIR cpoint = point(maze, cell);
+		if(search->expand(search, cell, &cpoint) == EXIT_FAILURE)
+			return EXIT_FAILURE;
 	}
-	data->ptr = tmp;
+	return EXIT_SUCCESS;
+}
+
+/*	Bidirectional A* as NBA* (Pijls and Post): the side with the smaller
+	queue is expanded, both sides share the closed set and a popped cell is
+	rejected when g + h or g + F - h' of the other side cannot beat the best
+	joined path. The search ends when either queue is empty. The open bits
+	mark every cell labelled by a side	*/
+static int
+bidirectional(SEARCH *forward, SEARCH *backward) {
+
+	const MAZE *maze = forward->maze;
+	if(search_start(forward, forward->start) == EXIT_FAILURE
+		|| search_start(backward, backward->start) == EXIT_FAILURE)
+		return EXIT_FAILURE;
+
+	while(forward->ph_root && backward->ph_root) {
 
+		SEARCH *search = forward->queued <= backward->queued ? forward : backward,
+			*other = search->other;
+		NODE *current = search->ph_root;
+		search->ph_root = __ph_pop(search, current);
+		--search->queued;
+		size_t cell = current->cell;
+		node_free(search, current);
+
+		if(FLAG_GET(search, closed, cell)) continue;
+		FLAG_SET(search, closed, cell);
+
+		PAIR cpoint = point(maze, cell);
+		long long distance = search->distance[cell];
+		if(distance + search->mh(&search->endpoint, &cpoint) >= search->length
+			|| distance + other->ph_root->fscore - other->mh(&other->endpoint, &cpoint)
+				>= search->length)
+			continue;
+		++search->expanded;
+
+		if(search->expand(search, cell, &cpoint) == EXIT_FAILURE)
+			return EXIT_FAILURE;
+	}
 	return EXIT_SUCCESS;
 }
 
-/*	Print result	*/
+static int
+flags_init(FLAGS *flags, size_t size) {
+
+	flags->bits = malloc(BITS_WORDS(size) * sizeof(BITS));
+	flags->stamp = calloc(BITS_WORDS(size), sizeof(STAMP));
+	return flags->bits && flags->stamp ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 static void
-print_maze(DATA *data) {
-
-	CELL *cell = data->ptr;
-	for(unsigned int x = 0; x < data->dimensions.x; ++x) {
-		for(unsigned int y = 0; y < data->dimensions.y; ++y) {
-
-			char c = cell->flag;
-			if(c & PATH) c = '*';
-			else if(c & VISITED) c = '.';
-			else if(c & TOP) c = '+';
-			else if(c & WALL) c = 'X';
-			else if(c & OPEN) c = ' ';
-			else c = '?';
-			putchar(c);
+flags_free(FLAGS *flags) {
+
+	free(flags->bits);
+	free(flags->stamp);
+}
+
+/*	Allocates the state of a search, search_query selects the endpoints	*/
+static int
+search_init(SEARCH *search, const MAZE *maze, int mode, const int *jumps) {
+
+	*search = (SEARCH){
+		.ph_cmp = cmp,
+		.mh = mh,
+		.maze = maze,
+		.distance = malloc(maze->size * sizeof(DISTANCE)),
+		.from = malloc((maze->size + 3) >> 2),
+		.expand = mode == ASTAR ? make_list : make_list_jps,
+		.jumps = jumps,
+	};
+	int err = flags_init(&search->open, maze->size);
+	err |= flags_init(&search->closed, maze->size);
+	if(! err && search->distance && search->from)
+		return EXIT_SUCCESS;
+
+	fprintf(stderr, "Memory allocation failed (malloc)\n");
+	return EXIT_FAILURE;
+}
+
+/*	Prepares a search for a new query, queued nodes return to the free
+	list and the opened/closed state is dropped by a new generation.
+	The stamps are cleared only when the generation wraps around	*/
+static void
+search_query(SEARCH *search, size_t start, size_t end) {
+
+	ph_destroy_heap(search);
+	search->queued = 0;
+	if(! ++search->generation) {
+		size_t words = BITS_WORDS(search->maze->size);
+		memset(search->open.stamp, 0, words * sizeof(STAMP));
+		memset(search->closed.stamp, 0, words * sizeof(STAMP));
+		search->generation = 1;
+	}
+	search->start = start;
+	search->end = end;
+	search->endpoint = point(search->maze, end);
+	search->length = UINT_MAX;
+	search->meet = NONE;
+}
+
+static void
+search_free(SEARCH *search) {
+
+	for(POOL *pool = search->pool, *next; pool; pool = next) {
+		next = pool->next;
+		free(pool);
+	}
+	flags_free(&search->open);
+	flags_free(&search->closed);
+	free(search->distance);
+	free(search->from);
+}
+
+/*	Path reconstruction, path cells are both open and closed. Jump points
+	are followed back along their direction until a closed cell with the
+	matching distance, in plain A* that is always the neighbour	*/
+static void
+mark_path(SEARCH *search) {
+
+	const MAZE *maze = search->maze;
+	size_t cell = search->end;
+	while(cell != search->start) {
+		DISTANCE distance = search->distance[cell];
+		unsigned int dir = DIR_GET(search->from, cell);
+		for(DISTANCE steps = 1;; ++steps) {
+			FLAG_SET(search, open, cell);
+			FLAG_SET(search, closed, cell);
+			cell = predecessor(maze, cell, dir);
+			if(FLAG_GET(search, closed, cell) && search->distance[cell] + steps == distance)
+				break;
+		}
+	}
+	FLAG_SET(search, open, cell);
+}
+
+/*	Searches from E share the closed set of the search from S	*/
+static int
+bidirectional_init(SEARCH *forward, SEARCH *backward, const MAZE *maze) {
+
+	int err = search_init(forward, maze, ASTAR, NULL);
+	if(search_init(backward, maze, ASTAR, NULL) == EXIT_FAILURE || err == EXIT_FAILURE)
+		return EXIT_FAILURE;
+	flags_free(&backward->closed);
+	backward->closed = forward->closed;
+	search_query(forward, maze->start, maze->end);
+	search_query(backward, maze->end, maze->start);
+	forward->other = backward;
+	backward->other = forward;
+	return EXIT_SUCCESS;
+}
+
+static void
+bidirectional_free(SEARCH *forward, SEARCH *backward) {
+
+	if(backward->closed.bits == forward->closed.bits)
+		backward->closed = (FLAGS){ NULL, NULL };
+	search_free(backward);
+	search_free(forward);
+}
+
+/*	Merges the labels of both sides into the forward search for printing,
+	the path is followed from the meeting cell back to S and to E	*/
+static void
+mark_bidirectional(SEARCH *forward, SEARCH *backward) {
+
+	const MAZE *maze = forward->maze;
+	STAMP generation = forward->generation;
+	for(size_t i = 0; i < BITS_WORDS(maze->size); ++i) {
+		BITS open = flag_word(&forward->open, generation, i)
+			| flag_word(&backward->open, backward->generation, i);
+		*flag_touch(&forward->open, generation, i) =
+			open & ~flag_word(&forward->closed, generation, i);
+	}
+
+	SEARCH *side[] = { forward, backward };
+	for(int i = 0; i < 2; ++i) {
+		for(size_t cell = forward->meet;; cell = predecessor(maze, cell, DIR_GET(side[i]->from, cell))) {
+			FLAG_SET(forward, open, cell);
+			FLAG_SET(forward, closed, cell);
+			if(cell == side[i]->start) break;
+		}
+	}
+}
+
+/*	Print result, one buffered write per row	*/
+static int
+print_maze(const SEARCH *search) {
+
+	const MAZE *maze = search->maze;
+	char *row = malloc(maze->dimensions.y + 1);
+	if(! row) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
+	}
+
+	size_t cell = 0;
+	for(unsigned int x = 0; x < maze->dimensions.x; ++x) {
+		for(unsigned int y = 0; y < maze->dimensions.y; ++y) {
+
+			char c;
+			int open = FLAG_GET(search, open, cell), closed = FLAG_GET(search, closed, cell);
+			if(open && closed) c = '*';
+			else if(closed) c = '.';
+			else if(open) c = '+';
+			else if(BIT_GET(maze->wall, cell)) c = 'X';
+			else c = ' ';
+			row[y] = c;
 			++cell;
 		}
-		putchar('\n');
+		row[maze->dimensions.y] = '\n';
+		fwrite(row, 1, maze->dimensions.y + 1, stdout);
+	}
+	free(row);
+	return EXIT_SUCCESS;
+}
+
+/*	Batch of queries answered against one maze, the workers take the
+	next query from an atomic counter and reuse their own search state	*/
+typedef struct query {
+	size_t start, end;
+	DISTANCE distance;
+} QUERY;
+
+typedef struct batch {
+	const MAZE *maze;
+	int mode;
+	const int *jumps;
+	QUERY *queries;
+	size_t count;
+	atomic_size_t next, expanded, pushes;
+	atomic_int err;
+} BATCH;
+
+/*	Reads "x1 y1 x2 y2" lines, returns the number of queries or 0	*/
+static size_t
+load_queries(QUERY **queries, const MAZE *maze, const char *path) {
+
+	FILE *file = fopen(path, "r");
+	if(! file) {
+		fprintf(stderr, "Cannot open %s\n", path);
+		return 0;
+	}
+
+	size_t count = 0, capacity = 0;
+	int err = 0;
+	for(unsigned int x1, y1, x2, y2; fscanf(file, "%u %u %u %u", &x1, &y1, &x2, &y2) == 4; ++count) {
+		if(x1 >= maze->dimensions.x || y1 >= maze->dimensions.y
+			|| x2 >= maze->dimensions.x || y2 >= maze->dimensions.y) {
+			fprintf(stderr, "Invalid query %zu\n", count + 1);
+			err = 1;
+			break;
+		}
+		if(count == capacity) {
+			capacity = capacity ? capacity * 2 : 1024;
+			QUERY *tmp = realloc(*queries, capacity * sizeof(QUERY));
+			if(! tmp) {
+				fprintf(stderr, "Memory allocation failed (realloc)\n");
+				err = 1;
+				break;
+			}
+			*queries = tmp;
+		}
+		(*queries)[count] = (QUERY){
+			.start = (size_t)x1 * maze->dimensions.y + y1,
+			.end = (size_t)x2 * maze->dimensions.y + y2,
+		};
+	}
+	/*	Errors inside the loop have already been reported	*/
+	if(! err && ! feof(file)) {
+		fprintf(stderr, "Invalid query %zu\n", count + 1);
+		err = 1;
+	} else if(! err && ! count) {
+		fprintf(stderr, "No queries in %s\n", path);
+		err = 1;
 	}
+	fclose(file);
+	return err ? 0 : count;
+}
+
+static void *
+batch_worker(void *arg) {
+
+	BATCH *batch = arg;
+	const MAZE *maze = batch->maze;
+	SEARCH search;
+	if(search_init(&search, maze, batch->mode, batch->jumps) == EXIT_FAILURE) {
+		atomic_store(&batch->err, 1);
+		search_free(&search);
+		return NULL;
+	}
+
+	for(size_t i; ! atomic_load(&batch->err)
+		&& (i = atomic_fetch_add(&batch->next, 1)) < batch->count; ) {
+
+		QUERY *query = batch->queries + i;
+		query->distance = UINT_MAX;
+		if(BIT_GET(maze->wall, query->start) || BIT_GET(maze->wall, query->end))
+			continue;
+
+		search_query(&search, query->start, query->end);
+		if(astar(&search) == EXIT_FAILURE) {
+			atomic_store(&batch->err, 1);
+			break;
+		}
+		if(FLAG_GET(&search, closed, query->end))
+			query->distance = search.distance[query->end];
+	}
+
+	atomic_fetch_add(&batch->expanded, search.expanded);
+	atomic_fetch_add(&batch->pushes, search.pushes);
+	search_free(&search);
+	return NULL;
+}
+
+static int
+run_batch(const MAZE *maze, int mode, const int *jumps, const char *path, unsigned int threads) {
+
+	BATCH batch = { .maze = maze, .mode = mode, .jumps = jumps, };
+	if(! (batch.count = load_queries(&batch.queries, maze, path))) {
+		free(batch.queries);
+		return EXIT_FAILURE;
+	}
+
+	pthread_t *workers = malloc(threads * sizeof(pthread_t));
+	if(! workers) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		free(batch.queries);
+		return EXIT_FAILURE;
+	}
+	unsigned int started = 0;
+	for(; started < threads; ++started) {
+		if(pthread_create(workers + started, NULL, batch_worker, &batch)) {
+			fprintf(stderr, "Cannot create thread\n");
+			atomic_store(&batch.err, 1);
+			break;
+		}
+	}
+	for(unsigned int i = 0; i < started; ++i)
+		pthread_join(workers[i], NULL);
+	free(workers);
+
+	if(! batch.err) {
+		for(size_t i = 0; i < batch.count; ++i) {
+			PAIR a = point(maze, batch.queries[i].start), b = point(maze, batch.queries[i].end);
+			DISTANCE distance = batch.queries[i].distance;
+			printf("%u %u %u %u %lld\n", a.x, a.y, b.x, b.y,
+				distance == UINT_MAX ? -1LL : (long long)distance);
+		}
+		printf("Queries: %zu, expanded cells: %zu, heap pushes: %zu\n",
+			batch.count, (size_t)batch.expanded, (size_t)batch.pushes);
+	}
+	free(batch.queries);
+	return batch.err ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
 int
 main(int argc, char *argv[]) {
 
-	while(--argc > 0) {
+	const char *output = NULL, *queries = NULL;
+	int mode = ASTAR, bidir = 0, threads = 1;
+	for(int opt; (opt = getopt(argc, argv, "o:jJbq:t:")) != -1; ) {
+		switch(opt) {
+			case 'o': output = optarg; break;
+			case 'j': mode = JPS; break;
+			case 'J': mode = JPS_PLUS; break;
+			case 'b': bidir = 1; break;
+			case 'q': queries = optarg; break;
+			case 't': threads = atoi(optarg); break;
+			default:
+				mode = -1;
+		}
+	}
+	if(mode < 0 || threads < 1 || (bidir && (mode != ASTAR || queries))) {
+		fprintf(stderr, "Usage: %s [-j | -J | -b] [-q queries.txt [-t threads]] "
+			"[-o maze.bin] <maze_file>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
 
-		DATA data = {
-			.ph_cmp = cmp,
-			.mh = mh,
-		};
+	while(--argc >= optind) {
+
+		MAZE maze = { 0 };
+		int *jumps = NULL;
 
-		FILE *file = fopen(argv[argc], "r");
-		if(! file) {
+		int fd = open(argv[argc], O_RDONLY);
+		if(fd < 0) {
 			fprintf(stderr, "Cannot open %s\n", argv[argc]);
 			continue;
 		}
-		int err = create_maze(&data, file);
-		fclose(file);
+		int err = create_maze(&maze, fd);
+		close(fd);
 		if(err == EXIT_FAILURE) {
 			fprintf(stderr, "Cannot load data from %s\n", argv[argc]);
+			maze_free(&maze);
 			return EXIT_FAILURE;
 		}
 
+		/*	Conversion only	*/
+		if(output) {
+			err = store_maze(&maze, output);
+			maze_free(&maze);
+			if(err == EXIT_FAILURE) return EXIT_FAILURE;
+			continue;
+		}
+
+		if(mode == JPS_PLUS && jumps_init(&maze, &jumps) == EXIT_FAILURE) {
+			maze_free(&maze);
+			return EXIT_FAILURE;
+		}
+
+		if(queries) {
+			err = run_batch(&maze, mode, jumps, queries, threads);
+			free(jumps);
+			maze_free(&maze);
+			if(err == EXIT_FAILURE) return EXIT_FAILURE;
+			continue;
+		}
+
 		/*	Check startpoint	*/
-		if(data.startpoint.y == 0) {
+		if(maze.start == SIZE_MAX) {
 			fprintf(stderr, "No startpoint specified\n");
 			return EXIT_FAILURE;
 		}
-		data.ph_root = data.ptr + data.startpoint.y;
-		data.startpoint.x = data.startpoint.y / data.dimensions.y;
-		data.startpoint.y %= data.dimensions.y;
 
 		/*	Check endpoint	*/
-		if(data.endpoint.y == 0) {
+		if(maze.end == SIZE_MAX) {
 			fprintf(stderr, "No endpoint specified\n");
 			return EXIT_FAILURE;
 		}
-		CELL *endpoint = data.ptr + data.endpoint.y;
-		data.endpoint.x = data.endpoint.y / data.dimensions.y;
-		data.endpoint.y %= data.dimensions.y;
 
-		astar(&data);
-		if(endpoint->flag & VISITED) {
-			printf("Found path, distance: %u\n", endpoint->distance);
+		if(bidir) {
+			SEARCH forward, backward;
+			err = bidirectional_init(&forward, &backward, &maze) == EXIT_FAILURE
+				|| bidirectional(&forward, &backward) == EXIT_FAILURE;
+			if(! err) {
+				if(forward.meet != NONE) {
+					printf("Found path, distance: %u\n", forward.length);
+					mark_bidirectional(&forward, &backward);
+				}
+				printf("Expanded cells: %zu, heap pushes: %zu\n",
+					forward.expanded + backward.expanded, forward.pushes + backward.pushes);
+				err = print_maze(&forward) == EXIT_FAILURE;
+			}
+			bidirectional_free(&forward, &backward);
+			maze_free(&maze);
+			if(err) return EXIT_FAILURE;
+			continue;
+		}
 
-			/*	Path reconstruction	*/
-			do endpoint->flag = PATH;
-			while((endpoint = endpoint->from));
+		SEARCH search;
+		if(search_init(&search, &maze, mode, jumps) == EXIT_FAILURE) {
+			search_free(&search);
+			free(jumps);
+			maze_free(&maze);
+			return EXIT_FAILURE;
 		}
+		search_query(&search, maze.start, maze.end);
+		if(astar(&search) == EXIT_FAILURE) {
+			search_free(&search);
+			free(jumps);
+			maze_free(&maze);
+			return EXIT_FAILURE;
+		}
+
+		if(FLAG_GET(&search, closed, maze.end)) {
+			printf("Found path, distance: %u\n", search.distance[maze.end]);
 
-		print_maze(&data);
+			mark_path(&search);
+		}
+		printf("Expanded cells: %zu, heap pushes: %zu\n", search.expanded, search.pushes);
+
+		err = print_maze(&search);
 
-		if(data.ptr)
-			free(data.ptr);
+		search_free(&search);
+		free(jumps);
+		maze_free(&maze);
+		if(err == EXIT_FAILURE) return EXIT_FAILURE;
 	}
 
 	return EXIT_SUCCESS;
 }
-
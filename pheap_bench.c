@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*	Pairing heap micro benchmarks
+	Compilation: cc -O2 pheap_bench.c
+	Optional flags:
+		WITH_PARENT_PTR - Use PHEAP_V2.h implementation
+		WITH_KEY - Compare inline keys without branches in the first pairing pass
+		PH_PREFETCH_DISTANCE=N - Prefetch N siblings ahead (e.g. -DPH_PREFETCH_DISTANCE=8)
+	Usage: ./a.out [heap size...]
+	Random keys are pushed, popped and destroyed, the report shows the time
+	and hardware counters (branch and last level cache misses) per node.
+	The first K nodes are peeked with pop and push back against ph_peek_k,
+	and the heap is walked with ph_foreach. With WITH_PARENT_PTR the heap
+	is also churned with random updates and popped with and without
+	ph_compact, and ph_extract_if is compared against ph_remove_at.
+	Counters are read with perf_event_open and printed as n/a when they
+	are not available.
+*/
+
+/*  Definition of a pairing heap node */
+typedef struct ph_node {
+	struct ph_node *ph_list, *ph_child;
+#ifdef WITH_PARENT_PTR
+	struct ph_node *ph_parent;
+#endif
+	int key;
+} PH_NODE;
+#define PH_NODE_DEFINED
+
+#define PH_DESTROY(ph_heap, node)
+
+#ifdef WITH_KEY
+#define PH_KEY(node) ((node)->key)
+#endif
+
+static int
+ph_cmp(const PH_NODE *const a, const PH_NODE *const b) {
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+#ifdef WITH_PARENT_PTR
+#include "PHEAP_V2.h"
+#else
+#include "PHEAP_V1.h"
+#endif
+
+/*	Hardware counters	*/
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int
+counter_open(unsigned long long config) {
+
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long
+counter_read(int fd) {
+
+	long long val;
+	if(fd < 0 || read(fd, &val, sizeof(val)) != sizeof(val))
+		return -1;
+	return val;
+}
+#define BRANCH_MISSES PERF_COUNT_HW_BRANCH_MISSES
+#define LLC_MISSES PERF_COUNT_HW_CACHE_MISSES
+#else
+#define counter_open(config) (-1)
+#define close(fd)
+#define counter_read(fd) (-1LL)
+#define BRANCH_MISSES 0
+#define LLC_MISSES 0
+#endif
+
+static struct counter {
+	const char *name;
+	unsigned long long config;
+	int fd;
+	long long start;
+} counters[] = {
+	{ .name = "branch-misses", .config = BRANCH_MISSES },
+	{ .name = "llc-misses", .config = LLC_MISSES },
+};
+#define COUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+static void
+counters_start(void) {
+
+	for(size_t i = 0; i < COUNTERS; ++i)
+		counters[i].start = counter_read(counters[i].fd);
+}
+
+static double
+now(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*	Prints the time and the counter deltas per node	*/
+static void
+counters_print(const char *name, double t0, size_t n) {
+
+	double t1 = now();
+	printf("%10zu %s: %.1f ns", n, name, (t1 - t0) / n);
+	for(size_t i = 0; i < COUNTERS; ++i) {
+		long long stop = counter_read(counters[i].fd);
+		if(counters[i].start < 0 || stop < 0)
+			printf(" %s: n/a", counters[i].name);
+		else printf(" %s: %.2f", counters[i].name,
+			(double)(stop - counters[i].start) / n);
+	}
+	putchar('\n');
+}
+
+/*	Pops every element and reports the cost per pop	*/
+static void
+bench_pop(PH_HEAP *heap, size_t n, const char *name) {
+
+	counters_start();
+	double t0 = now();
+	for(PH_NODE *root = heap->ph_root; root; root = __ph_pop(heap, root));
+	counters_print(name, t0, n);
+	heap->ph_root = NULL;
+}
+
+/*	Walks the whole heap with ph_destroy_heap	*/
+static void
+bench_destroy(PH_HEAP *heap, size_t n) {
+
+	counters_start();
+	double t0 = now();
+	ph_destroy_heap(heap);
+	counters_print("destroy", t0, n);
+}
+
+/*	ph_foreach visitor	*/
+static void
+visit(PH_NODE *node, void *arg) {
+
+	(void)node;
+	(void)arg;
+}
+
+/*	Reads the first K nodes repeatedly, by popping and pushing them back and
+	with ph_peek_k, then walks the heap with ph_foreach. The heap is paired
+	once first, a heap of ph_push_raw only would be one long root list	*/
+static int
+bench_peek(PH_HEAP *heap, size_t n) {
+
+	enum { K = 100, ROUNDS = 100 };
+	PH_NODE **frontier = malloc(n * sizeof(PH_NODE *)), *out[K], *root = heap->ph_root;
+	if(! frontier) return -1;
+	heap->ph_root = __ph_pop(heap, root);
+	ph_push_raw(heap, root);
+
+	size_t k = n < K ? n : K;
+	double t0 = now();
+	for(size_t r = 0; r < ROUNDS; ++r) {
+		for(size_t j = 0; j < k; ++j) {
+			out[j] = heap->ph_root;
+			heap->ph_root = __ph_pop(heap, out[j]);
+		}
+		for(size_t j = 0; j < k; ++j)
+			ph_push_raw(heap, out[j]);
+	}
+	double t1 = now();
+	for(size_t r = 0; r < ROUNDS; ++r)
+		ph_peek_k(heap, out, k, frontier, n);
+	double t2 = now();
+	size_t visited = ph_foreach(heap, visit, NULL, frontier, n);
+	double t3 = now();
+	printf("%10zu peek %zu: pop + push %.1f ns, ph_peek_k %.1f ns per node, foreach %.1f ns per node\n",
+		n, k, (t1 - t0) / (ROUNDS * k), (t2 - t1) / (ROUNDS * k), (t3 - t2) / visited);
+
+	free(frontier);
+	return 0;
+}
+
+#ifdef WITH_PARENT_PTR
+/*	Pushes the nodes in random memory order and updates n of them	*/
+static void
+churn_build(PH_HEAP *heap, PH_NODE *data, PH_NODE **order, size_t n) {
+
+	srand(2);
+	for(size_t j = 0; j < n; ++j) {
+		size_t k = rand() % (j + 1);
+		order[j] = order[k];
+		order[k] = data + j;
+	}
+
+	for(size_t j = 0; j < n; ++j) {
+		order[j]->key = rand();
+		ph_push_raw(heap, order[j]);
+	}
+	for(size_t j = 0; j < n; ++j) {
+		PH_NODE *node = order[rand() % n];
+		node->key = rand();
+		ph_decrease_at(heap, node);
+	}
+}
+
+/*	Nodes are pushed in random memory order and updated n times, then
+	the heap is popped, optionally after relocating it with ph_compact	*/
+static int
+bench_churn(size_t n, int compact) {
+
+	PH_NODE *data = malloc(n * sizeof(PH_NODE)), *arena = NULL,
+		**order = malloc(n * sizeof(PH_NODE *));
+	if(! data || ! order) {
+		free(data);
+		free(order);
+		return -1;
+	}
+
+	PH_HEAP heap = { .ph_cmp = ph_cmp, };
+	churn_build(&heap, data, order, n);
+
+	if(compact) {
+		if(! (arena = malloc(n * sizeof(PH_NODE)))) {
+			free(data);
+			free(order);
+			return -1;
+		}
+		double t0 = now();
+		ph_compact(&heap, arena, n);
+		printf("%10zu compact: %.1f ns per node\n", n, (now() - t0) / n);
+	}
+	bench_pop(&heap, n, compact ? "churn pop (compacted)" : "churn pop");
+
+	free(arena);
+	free(data);
+	free(order);
+	return 0;
+}
+
+/*	ph_extract_if predicate, matches every key divisible by *arg	*/
+static int
+divisible(const PH_NODE *const node, void *arg) {
+
+	return node->key % *(int *)arg == 0;
+}
+
+/*	Moves the keys divisible by 1000, 100, 10 and 2 out of a churned heap,
+	with ph_extract_if and with ph_remove_at on the matches found by a scan
+	of the node array	*/
+static int
+bench_extract(size_t n) {
+
+	static int divisors[] = { 1000, 100, 10, 2 };
+	PH_NODE *data = malloc(n * sizeof(PH_NODE)),
+		**order = malloc(n * sizeof(PH_NODE *));
+	if(! data || ! order) {
+		free(data);
+		free(order);
+		return -1;
+	}
+
+	for(size_t i = 0; i < sizeof(divisors) / sizeof(divisors[0]); ++i) {
+		int d = divisors[i];
+		double time[2];
+		size_t moved = 0;
+		for(int method = 0; method < 2; ++method) {
+			PH_HEAP heap = { .ph_cmp = ph_cmp, }, out = { .ph_cmp = ph_cmp, };
+			churn_build(&heap, data, order, n);
+			double t0 = now();
+			if(method)
+				moved = ph_extract_if(&heap, divisible, &d, &out);
+			else {
+				for(size_t j = 0; j < n; ++j) {
+					if(data[j].key % d) continue;
+					ph_remove_at(&heap, data + j);
+					ph_push_raw(&out, data + j);
+				}
+			}
+			time[method] = now() - t0;
+		}
+		printf("%10zu extract 1/%d: ph_remove_at %.1f ms, ph_extract_if %.1f ms, %zu moved\n",
+			n, d, time[0] / 1e6, time[1] / 1e6, moved);
+	}
+
+	free(data);
+	free(order);
+	return 0;
+}
+#endif
+
+int
+main(int argc, char *argv[]) {
+
+	size_t sizes[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 22 }, count = 4;
+	if(argc > 1) {
+		for(count = 0; count < 4 && count + 1 < (size_t)argc; ++count)
+			sizes[count] = strtoull(argv[count + 1], NULL, 10);
+	}
+
+	for(size_t i = 0; i < COUNTERS; ++i)
+		counters[i].fd = counter_open(counters[i].config);
+	srand(1);
+	for(size_t i = 0; i < count; ++i) {
+		size_t n = sizes[i];
+		PH_NODE *data = calloc(n, sizeof(PH_NODE));
+		if(! data) {
+			fprintf(stderr, "Memory allocation failed (calloc)\n");
+			return EXIT_FAILURE;
+		}
+
+		PH_HEAP heap = { .ph_cmp = ph_cmp, };
+		for(size_t j = 0; j < n; ++j) {
+			data[j].key = rand();
+			ph_push_raw(&heap, data + j);
+		}
+		if(bench_peek(&heap, n)) {
+			fprintf(stderr, "Memory allocation failed (malloc)\n");
+			return EXIT_FAILURE;
+		}
+		bench_pop(&heap, n, "pop");
+		for(size_t j = 0; j < n; ++j)
+			ph_push_raw(&heap, data + j);
+		bench_destroy(&heap, n);
+		free(data);
+#ifdef WITH_PARENT_PTR
+		if(bench_churn(n, 0) || bench_churn(n, 1) || bench_extract(n)) {
+			fprintf(stderr, "Memory allocation failed\n");
+			return EXIT_FAILURE;
+		}
+#endif
+	}
+
+	for(size_t i = 0; i < COUNTERS; ++i) {
+		if(counters[i].fd >= 0)
+			close(counters[i].fd);
+	}
+	return EXIT_SUCCESS;
+}
@@ -6,8 +6,13 @@
 	Optional flags:
 		WITH_PARENT_PTR - Use PHEAP_V2.h implementation
 		WITH_ARG - Use three-argument comparator function
+		WITH_KEY - Compare inline keys without branches in the first pairing pass
+		WITH_SNAPSHOT - Store or restore the heap with PHEAP_SNAPSHOT.h
 	Usage: ./a.out <file.txt>
 	Provide a text file containing the numbers to be sorted.
+	With WITH_SNAPSHOT:
+		./a.out -s <heap.snap> <file.txt> stores the heap before sorting
+		./a.out -r <heap.snap> sorts a stored heap without loading the data
 */
 
 #ifndef NOPRINT
@@ -59,6 +64,14 @@ ph_cmp(const PH_NODE *const a, const PH_NODE *const b) {
 }
 #endif
 
+#ifdef WITH_KEY
+#ifdef WITH_ARG
+#error "WITH_KEY cannot be combined with WITH_ARG"
+#endif
+/*  Use the inline key mode, see PHEAP_KEY.h  */
+#define PH_KEY(node) ((node)->key)
+#endif
+
 /*  Include the appropriate pairing heap implementation */
 #ifdef WITH_PARENT_PTR
 #include "PHEAP_V2.h"
@@ -66,6 +79,10 @@ ph_cmp(const PH_NODE *const a, const PH_NODE *const b) {
 #include "PHEAP_V1.h"
 #endif
 
+#ifdef WITH_SNAPSHOT
+#include "PHEAP_SNAPSHOT.h"
+#endif
+
 /*	Function to load data from file or stdin  */
 #include <string.h>
 #define POW 5
@@ -118,6 +135,25 @@ main(int argc, char *argv[]) {
 	PH_NODE *data = NULL;
 	int n = -1;
 
+#ifdef WITH_SNAPSHOT
+	const char *snapshot = NULL;
+	if(argc > 2 && ! strcmp(argv[1], "-r")) {
+		PH_SNAPSHOT snap = { 0 };
+		if(ph_restore(&snap, &heap, argv[2])) {
+			fprintf(stderr, "Cannot restore %s\n", argv[2]);
+			return EXIT_FAILURE;
+		}
+		sort_data(&heap);
+		ph_release(&snap);
+		return EXIT_SUCCESS;
+	}
+	if(argc > 2 && ! strcmp(argv[1], "-s")) {
+		snapshot = argv[2];
+		argv += 2;
+		argc -= 2;
+	}
+#endif
+
 	if(argc < 2) {
 		puts("Reading input from stdin");
 		if((n = load_data(&data, stdin, n)) < 0)
@@ -133,6 +169,13 @@ main(int argc, char *argv[]) {
 	}
 
 	insert_data(&heap, data, n);
+#ifdef WITH_SNAPSHOT
+	if(snapshot && ph_snapshot(&heap, data, n + 1, snapshot)) {
+		fprintf(stderr, "Cannot store %s\n", snapshot);
+		n = -1;
+		goto failure;
+	}
+#endif
 	sort_data(&heap);
 
 #ifdef WITH_ARG
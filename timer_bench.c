@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*	Timer scheduler benchmark
+	Compilation: cc -O2 timer_bench.c
+	Usage: ./a.out [timers] [cancel percent]
+	A simulated event loop keeps the timers armed: every tick a batch of
+	random timers is touched, armed timers are cancelled with the given
+	probability and postponed otherwise, idle timers are armed again.
+	70% of the timeouts are short (up to 200 ticks), the rest up to 100000
+	ticks. The same operations run on PHEAP_TIMER.h and on a plain heap
+	with ph_remove_at + ph_push_raw updates and one __ph_pop per expiry.
+*/
+
+#define PH_DESTROY(ph_heap, node)
+
+#include "PHEAP_TIMER.h"
+
+enum {
+	TICKS = 1024,
+	SHORT = 200,
+	LONG = 100000,
+};
+
+/*	xorshift generator, both schedulers see the same sequence	*/
+static uint64_t seed;
+
+static uint64_t
+next_random(void) {
+
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+static uint64_t
+timeout(void) {
+	return next_random() % 10 < 7 ? 1 + next_random() % SHORT : 1 + next_random() % LONG;
+}
+
+/*	Plain heap operations, ph_slot only tells armed timers apart	*/
+static void
+heap_arm(PT_SCHED *sched, PH_NODE *node, uint64_t expiry) {
+
+	node->ph_expiry = expiry;
+	node->ph_slot = PT_HEAP;
+	ph_push_raw(&sched->ph_heap, node);
+}
+
+static void
+heap_cancel(PT_SCHED *sched, PH_NODE *node) {
+
+	ph_remove_at(&sched->ph_heap, node);
+	node->ph_slot = PT_IDLE;
+}
+
+static void
+heap_reschedule(PT_SCHED *sched, PH_NODE *node, uint64_t expiry) {
+
+	ph_remove_at(&sched->ph_heap, node);
+	node->ph_expiry = expiry;
+	ph_push_raw(&sched->ph_heap, node);
+}
+
+static size_t
+heap_expire(PT_SCHED *sched, uint64_t now) {
+
+	size_t count = 0;
+	PH_HEAP *heap = &sched->ph_heap;
+	for(PH_NODE *root; (root = heap->ph_root) && root->ph_expiry <= now; ++count) {
+		heap->ph_root = __ph_pop(heap, root);
+		root->ph_slot = PT_IDLE;
+	}
+	return count;
+}
+
+static size_t
+wheel_expire(PT_SCHED *sched, uint64_t now) {
+
+	size_t count = 0;
+	for(PH_NODE *node = pt_expire(sched, now); node; node = node->ph_list)
+		++count;
+	return count;
+}
+
+static double
+now_ns(void) {
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*	Runs the event loop, returns the number of expired timers	*/
+static size_t
+run(PH_NODE *timers, size_t n, unsigned int cancel, int wheel) {
+
+	static PT_SCHED sched;
+	sched = (PT_SCHED){ .ph_now = 0 };
+	seed = 88172645463325252ULL;
+
+	double t0 = now_ns();
+	for(size_t i = 0; i < n; ++i) {
+		pt_init(timers + i);
+		if(wheel) pt_arm(&sched, timers + i, timeout());
+		else heap_arm(&sched, timers + i, timeout());
+	}
+	double t1 = now_ns();
+
+	size_t expired = 0, ops = 0, batch = n / 64;
+	for(uint64_t tick = 0; tick < TICKS; ++tick) {
+		for(size_t i = 0; i < batch; ++i, ++ops) {
+			PH_NODE *node = timers + next_random() % n;
+			uint64_t expiry = tick + timeout();
+			if(node->ph_slot == PT_IDLE) {
+				if(wheel) pt_arm(&sched, node, expiry);
+				else heap_arm(&sched, node, expiry);
+			} else if(next_random() % 100 < cancel) {
+				if(wheel) pt_cancel(&sched, node);
+				else heap_cancel(&sched, node);
+			} else {
+				if(wheel) pt_reschedule(&sched, node, expiry);
+				else heap_reschedule(&sched, node, expiry);
+			}
+		}
+		expired += wheel ? wheel_expire(&sched, tick) : heap_expire(&sched, tick);
+	}
+	double t2 = now_ns();
+
+	printf("%10zu %s: arm %.1f ns, loop %.1f ns per operation, %zu expired\n",
+		n, wheel ? "wheel + heap" : "heap", (t1 - t0) / n, (t2 - t1) / (ops + expired), expired);
+	return expired;
+}
+
+int
+main(int argc, char *argv[]) {
+
+	size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1 << 20;
+	unsigned int cancel = argc > 2 ? atoi(argv[2]) : 90;
+	PH_NODE *timers = n ? malloc(n * sizeof(PH_NODE)) : NULL;
+	if(! timers) {
+		fprintf(stderr, "Memory allocation failed (malloc)\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%u%% cancelled\n", cancel);
+	size_t expired = run(timers, n, cancel, 0);
+	if(run(timers, n, cancel, 1) != expired)
+		fprintf(stderr, "Expired timer counts differ\n");
+	free(timers);
+	return EXIT_SUCCESS;
+}